@@ -0,0 +1,235 @@
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <eventloop.hpp>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <threadpool.hpp>
+#include <timer.hpp>
+
+#include "../http/httpdata.cpp"
+#include "../http/httpprocess.cpp"
+
+// 组件微基准测试
+// 每项测试重复多次取中位数与最小值,以稳定的JSON格式输出,便于不同提交之间对比
+// 用法: bench [名称过滤子串]
+
+namespace sinksky {
+    using std::string;
+    using std::vector;
+    using clk = std::chrono::steady_clock;
+
+    static double elapsedNs(clk::time_point start) {
+        return std::chrono::duration<double, std::nano>(clk::now() - start).count();
+    }
+
+    // 直接访问httpprocess与httpdata的内部实现
+    class httpbench {
+      private:
+        conn<httpdata> c;
+        httpprocess proc;
+
+      public:
+        httpbench() : proc(&c) {
+            c.fd = -1;
+            c.traceId = 0;
+            c.op = nullptr;
+            c.timer = nullptr;
+            c.data = std::make_unique<httpdata>();
+        }
+
+        // 解析一个完整请求,在查找文件之前停止,结果不受文件系统影响
+        int parse(const string &req) {
+            httpdata *data = c.data.get();
+            data->init();
+            memcpy(data->readBuf.get(), req.data(), req.size());
+            data->readIdx = req.size();
+            return static_cast<int>(proc.parseRequest());
+        }
+
+        // 组装响应头(不包含发送)
+        int respond(HttpCode code, off_t size) {
+            httpdata *data = c.data.get();
+            data->writeIdx = 0;
+            data->writeIvCount = 0;
+            data->fileStat.st_size = size;
+            proc.processWrite(code);
+            return data->writeIdx;
+        }
+    };
+}  // namespace sinksky
+
+using namespace sinksky;
+
+struct result {
+    string name;
+    long iterations;
+    double nsPerOp;
+    double minNsPerOp;
+};
+
+static const int REPEAT = 7;
+static vector<result> results;
+static const char *filter = nullptr;
+
+// fn(iterations) 返回本轮耗时(纳秒),由测试自行决定计时范围
+template <typename Func>
+static void run(const string &name, long iterations, Func &&fn) {
+    if (filter != nullptr && name.find(filter) == string::npos) return;
+    vector<double> samples;
+    fn(iterations / 10 + 1);  // 预热
+    for (int i = 0; i < REPEAT; ++i) {
+        samples.push_back(fn(iterations) / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+    results.push_back({name, iterations, samples[REPEAT / 2], samples[0]});
+}
+
+static vector<std::pair<string, string>> loadCorpus(const string &dir) {
+    vector<std::pair<string, string>> corpus;
+    DIR *dp = opendir(dir.c_str());
+    if (dp == nullptr) return corpus;
+    while (dirent *ent = readdir(dp)) {
+        string name = ent->d_name;
+        if (name.size() < 5 || name.compare(name.size() - 5, 5, ".http")) continue;
+        std::ifstream in(dir + "/" + name, std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        string req = ss.str();
+        if (req.size() < httpdata::READ_BUF_SIZE) {
+            corpus.emplace_back(name.substr(0, name.size() - 5), req);
+        }
+    }
+    closedir(dp);
+    std::sort(corpus.begin(), corpus.end());
+    return corpus;
+}
+
+static void benchParser(const vector<std::pair<string, string>> &corpus) {
+    httpbench hb;
+    for (auto &item : corpus) {
+        const string &req = item.second;
+        run("http/parseRequest/" + item.first, 5000, [&](long n) {
+            auto start = clk::now();
+            for (long i = 0; i < n; ++i) hb.parse(req);
+            return elapsedNs(start);
+        });
+    }
+    run("http/parseRequest/corpus_mix", 5000, [&](long n) {
+        auto start = clk::now();
+        for (long i = 0; i < n; ++i) hb.parse(corpus[i % corpus.size()].second);
+        return elapsedNs(start);
+    });
+}
+
+static void benchResponse() {
+    httpbench hb;
+    run("http/addResponse/200_file", 1000000, [&](long n) {
+        auto start = clk::now();
+        for (long i = 0; i < n; ++i) hb.respond(HttpCode::FILE_REQUEST, 1048576);
+        return elapsedNs(start);
+    });
+    run("http/addResponse/404", 1000000, [&](long n) {
+        auto start = clk::now();
+        for (long i = 0; i < n; ++i) hb.respond(HttpCode::NO_RESOURCE, 0);
+        return elapsedNs(start);
+    });
+}
+
+static void benchTimer() {
+    const long TIMER_NUM = 100000;
+    using timerHeapb = timerHeap<function<void()>>;
+    using timerNodeb = timerNode<function<void()>>;
+
+    run("timer/addTimer/100k", TIMER_NUM, [&](long n) {
+        std::mt19937 rng(42);
+        timerHeapb heap;
+        auto start = clk::now();
+        for (long i = 0; i < n; ++i) heap.addTimer(rng() % 60 + 1, []() {});
+        return elapsedNs(start);
+    });
+    run("timer/updateTimer/100k", TIMER_NUM, [&](long n) {
+        std::mt19937 rng(42);
+        timerHeapb heap;
+        vector<timerNodeb *> timers;
+        for (long i = 0; i < n; ++i) timers.push_back(heap.addTimer(rng() % 60 + 1, []() {}));
+        auto start = clk::now();
+        for (long i = 0; i < n; ++i) timers[i] = heap.updateTimer(timers[i], rng() % 60 + 1);
+        return elapsedNs(start);
+    });
+    // 同一连接在一秒内多次重新排队,截止时间不变
+    run("timer/updateTimer/same_deadline", TIMER_NUM, [&](long n) {
+        timerHeapb heap;
+        timerNodeb *timer = heap.addTimer(15, []() {});
+        auto start = clk::now();
+        for (long i = 0; i < n; ++i) timer = heap.updateTimer(timer, 15);
+        return elapsedNs(start);
+    });
+    run("timer/tick/100k_expired", TIMER_NUM, [&](long n) {
+        timerHeapb heap;
+        long fired = 0;
+        for (long i = 0; i < n; ++i) heap.addTimer(0, [&fired]() { ++fired; });
+        auto start = clk::now();
+        heap.tick();
+        return elapsedNs(start);
+    });
+    run("timer/tick/100k_cancelled", TIMER_NUM, [&](long n) {
+        timerHeapb heap;
+        for (long i = 0; i < n; ++i) heap.delTimer(heap.addTimer(0, []() {}));
+        auto start = clk::now();
+        heap.tick();
+        return elapsedNs(start);
+    });
+}
+
+static void benchThreadpool(int producers) {
+    static int token;
+    string name = "threadpool/add_take/" + std::to_string(producers) + "p"
+                  + std::to_string(producers) + "c";
+    run(name, 1000000, [&](long n) {
+        // 不启动内部工作线程,由测试线程直接调用add/take
+        threadpool<int *> pool(0, eventloop<httpdata>::MAX_EVENT_NUM);
+        long per = n / producers;
+        vector<std::thread> threads;
+        auto start = clk::now();
+        for (int p = 0; p < producers; ++p) {
+            threads.emplace_back([&pool, per]() {
+                for (long i = 0; i < per; ++i) pool.add(&token);
+            });
+            threads.emplace_back([&pool, per]() {
+                for (long i = 0; i < per; ++i) pool.take();
+            });
+        }
+        for (auto &t : threads) t.join();
+        return elapsedNs(start) * n / (per * producers);
+    });
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) filter = argv[1];
+
+    auto corpus = loadCorpus(HSHR_BENCH_CORPUS);
+    if (corpus.empty()) {
+        fprintf(stderr, "no request corpus found in %s\n", HSHR_BENCH_CORPUS);
+        return 1;
+    }
+
+    benchParser(corpus);
+    benchResponse();
+    benchTimer();
+    benchThreadpool(1);
+    benchThreadpool(4);
+
+    printf("{\n  \"schema\": 1,\n  \"repeat\": %d,\n  \"benchmarks\": [\n", REPEAT);
+    for (size_t i = 0; i < results.size(); ++i) {
+        printf("    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.1f, "
+               "\"min_ns_per_op\": %.1f}%s\n",
+               results[i].name.c_str(), results[i].iterations, results[i].nsPerOp,
+               results[i].minNsPerOp, i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
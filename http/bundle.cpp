@@ -0,0 +1,191 @@
+#pragma once
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace sinksky {
+    using std::string;
+
+    // 静态资源包的文件格式,由 tools/hshrpack 生成,使用本机字节序
+    // 所有偏移都相对于文件开头,整个文件映射后响应直接引用映射中的切片
+    struct bundleHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+        uint32_t tableSize;
+        uint32_t reserved;
+        uint64_t tableOffset;  // uint32_t[tableSize] 完美哈希的种子表
+        uint64_t entryOffset;  // bundleEntry[count]
+        uint64_t fileSize;
+    };
+
+    struct bundleSlice {
+        uint64_t offset;
+        uint64_t len;
+    };
+
+    struct bundleEntry {
+        bundleSlice url;
+        bundleSlice etag;
+        bundleSlice head;  // 预先生成的响应头,不含Connection与结尾空行
+        bundleSlice body;
+        bundleSlice gzipHead;
+        bundleSlice gzipBody;  // len为0表示没有预压缩版本
+        bundleSlice gzipEtag;  // 预压缩版本是不同的表示,使用单独的强ETag
+    };
+
+    static const char bundleMagic[8] = {'H', 'S', 'H', 'R', 'P', 'A', 'K', '1'};
+    static const uint32_t bundleVersion = 2;
+
+    inline uint64_t bundleHash(const char *p, size_t len, uint32_t seed) {
+        uint64_t h = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+        for (size_t i = 0; i < len; ++i) {
+            h ^= (uint8_t)p[i];
+            h *= 0x100000001b3ULL;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // 两级完美哈希(hash and displace): 种子0选出第一级的桶,桶中记录的种子把该桶的URL映射到互不冲突的表项
+    inline uint32_t bundleSlot(const char *url, size_t len, const uint32_t *table, uint32_t tableSize,
+                               uint32_t count) {
+        uint32_t seed = table[bundleHash(url, len, 0) % tableSize];
+        return bundleHash(url, len, seed) % count;
+    }
+
+    // 只读的静态资源包
+    // 启动时映射一次并校验所有切片,之后查找只有两次哈希与一次比较,不需要文件系统调用
+    class bundle {
+      private:
+        static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+        char *base;
+        size_t mapLen;
+        const bundleHeader *header;
+        const uint32_t *table;
+        const bundleEntry *entries;
+
+        // 大页模式把文件读入匿名内存,优先使用预留的大页,否则交给透明大页
+        char *mapHuge(int fd, size_t size) {
+            mapLen = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+            void *addr = mmap(0, mapLen, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (addr == MAP_FAILED) {
+                addr = mmap(0, mapLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (addr == MAP_FAILED) return nullptr;
+                madvise(addr, mapLen, MADV_HUGEPAGE);
+            }
+            size_t done = 0;
+            while (done < size) {
+                auto cnt = pread(fd, (char *)addr + done, size - done, done);
+                if (cnt <= 0) {
+                    munmap(addr, mapLen);
+                    return nullptr;
+                }
+                done += cnt;
+            }
+            mprotect(addr, mapLen, PROT_READ);
+            return (char *)addr;
+        }
+
+        bool valid(const bundleSlice &s) const {
+            return s.offset <= header->fileSize && s.len <= header->fileSize - s.offset;
+        }
+
+        bool validate(size_t size) {
+            if (size < sizeof(bundleHeader)) return false;
+            header = (const bundleHeader *)base;
+            if (memcmp(header->magic, bundleMagic, sizeof(bundleMagic)) != 0
+                || header->version != bundleVersion || header->fileSize != size
+                || (header->count != 0 && header->tableSize == 0)) {
+                return false;
+            }
+            bundleSlice tableSlice{header->tableOffset, (uint64_t)header->tableSize * sizeof(uint32_t)};
+            bundleSlice entrySlice{header->entryOffset, (uint64_t)header->count * sizeof(bundleEntry)};
+            if (!valid(tableSlice) || !valid(entrySlice) || header->tableOffset % sizeof(uint32_t)
+                || header->entryOffset % sizeof(uint64_t)) {
+                return false;
+            }
+            table = (const uint32_t *)(base + header->tableOffset);
+            entries = (const bundleEntry *)(base + header->entryOffset);
+            for (uint32_t i = 0; i < header->count; ++i) {
+                const bundleEntry &e = entries[i];
+                if (!valid(e.url) || !valid(e.etag) || !valid(e.head) || !valid(e.body)
+                    || !valid(e.gzipHead) || !valid(e.gzipBody) || !valid(e.gzipEtag)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+      public:
+        bundle() : base(nullptr), mapLen(0), header(nullptr), table(nullptr), entries(nullptr) {}
+        ~bundle() {
+            if (base != nullptr) munmap(base, mapLen);
+        }
+        bundle(const bundle &) = delete;
+        bundle &operator=(const bundle &) = delete;
+
+        bool load(const char *path, bool hugepage) {
+            int fd = open(path, O_RDONLY);
+            if (fd < 0) {
+                perror(path);
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) < 0 || st.st_size == 0) {
+                close(fd);
+                fprintf(stderr, "%s: empty bundle\n", path);
+                return false;
+            }
+            if (hugepage) {
+                base = mapHuge(fd, st.st_size);
+            } else {
+                mapLen = st.st_size;
+                void *addr = mmap(0, mapLen, PROT_READ, MAP_PRIVATE, fd, 0);
+                base = addr == MAP_FAILED ? nullptr : (char *)addr;
+                if (base != nullptr) madvise(base, mapLen, MADV_WILLNEED);
+            }
+            close(fd);
+            if (base == nullptr) {
+                perror(path);
+                return false;
+            }
+            if (!validate(st.st_size)) {
+                fprintf(stderr, "%s: not a valid bundle\n", path);
+                munmap(base, mapLen);
+                base = nullptr;
+                return false;
+            }
+            return true;
+        }
+
+        bool loaded() const { return base != nullptr; }
+
+        uint32_t size() const { return loaded() ? header->count : 0; }
+
+        const bundleEntry *find(const string &url) const {
+            if (header->count == 0) return nullptr;
+            const bundleEntry *e = &entries[bundleSlot(url.data(), url.size(), table,
+                                                       header->tableSize, header->count)];
+            if (e->url.len != url.size() || memcmp(slice(e->url), url.data(), url.size()) != 0) {
+                return nullptr;
+            }
+            return e;
+        }
+
+        const char *slice(const bundleSlice &s) const { return base + s.offset; }
+    };
+
+}  // namespace sinksky
@@ -0,0 +1,145 @@
+#pragma once
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hpack.cpp"
+
+namespace sinksky {
+    using std::deque;
+    using std::map;
+    using std::shared_ptr;
+    using std::string;
+    using std::vector;
+
+    enum class H2Frame : uint8_t {
+        DATA = 0x0,
+        HEADERS = 0x1,
+        PRIORITY = 0x2,
+        RST_STREAM = 0x3,
+        SETTINGS = 0x4,
+        PUSH_PROMISE = 0x5,
+        PING = 0x6,
+        GOAWAY = 0x7,
+        WINDOW_UPDATE = 0x8,
+        CONTINUATION = 0x9
+    };
+    enum class H2Error : uint32_t {
+        NO_ERROR = 0x0,
+        PROTOCOL_ERROR = 0x1,
+        INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3,
+        FRAME_SIZE_ERROR = 0x6,
+        REFUSED_STREAM = 0x7,
+        COMPRESSION_ERROR = 0x9,
+        ENHANCE_YOUR_CALM = 0xb
+    };
+
+    class h2process;
+
+    // HTTP/2 流
+    // 响应体直接引用映射的文件,发送队列通过shared_ptr保证映射在发送完之前有效
+    class h2stream {
+        friend class h2process;
+
+      private:
+        uint32_t id;
+        int64_t sendWindow;
+        bool endStream;
+        bool headOnly;
+        const char *body;
+        size_t bodyLen;
+        size_t bodySent;
+        char *fileAddress;
+        size_t fileLen;
+
+      public:
+        h2stream(uint32_t id, int64_t window)
+            : id(id),
+              sendWindow(window),
+              endStream(false),
+              headOnly(false),
+              body(nullptr),
+              bodyLen(0),
+              bodySent(0),
+              fileAddress(nullptr),
+              fileLen(0) {}
+        ~h2stream() {
+            if (fileAddress != nullptr) {
+                munmap(fileAddress, fileLen);
+            }
+        }
+        h2stream(const h2stream &) = delete;
+        h2stream &operator=(const h2stream &) = delete;
+    };
+
+    // 待发送的数据段,帧头等小块数据自身持有,响应体只记录位置
+    struct h2segment {
+        string owned;
+        const char *ptr;
+        size_t len;
+        shared_ptr<h2stream> ref;
+    };
+
+    // HTTP/2 连接状态,保存在httpdata中,连接升级后一直存在
+    class h2session {
+        friend class h2process;
+
+      public:
+        static const int PREFACE_LEN = 24;
+        static const uint32_t MAX_FRAME_SIZE = 16384;
+        static const uint32_t MAX_STREAM_NUM = 100;
+        static const size_t MAX_IN_SIZE = 256 * 1024;
+        // 头部块(含CONTINUATION)与解码后头部列表的上限,超出时发送GOAWAY
+        static const size_t MAX_HEADER_LIST_SIZE = 64 * 1024;
+        static const size_t MAX_OUT_SIZE = 256 * 1024;
+        static const char *const preface;
+
+      private:
+        hpackDecoder decoder;
+        vector<char> inBuf;
+        deque<h2segment> out;
+        size_t outBytes;
+        size_t outSent;  // 队首数据段已发送的字节数
+
+        map<uint32_t, shared_ptr<h2stream>> streams;
+        deque<uint32_t> active;  // 有响应体待发送的流,轮转调度
+        int64_t sendWindow;
+        int64_t peerInitialWindow;
+        uint32_t peerMaxFrameSize;
+        uint32_t lastStreamId;
+        uint32_t continuationId;  // 等待CONTINUATION的流,0表示没有
+        string headerBlock;
+        bool headerEndStream;
+        bool prefaceDone;
+        bool closing;
+        bool peerGone;  // 对端发送了GOAWAY,不会再发起新流,现有流完成后关闭
+        bool goingAway;  // 已发送GOAWAY(NO_ERROR),不再接受新流,现有流完成后关闭
+
+      public:
+        h2session()
+            : outBytes(0),
+              outSent(0),
+              sendWindow(65535),
+              peerInitialWindow(65535),
+              peerMaxFrameSize(16384),
+              lastStreamId(0),
+              continuationId(0),
+              headerEndStream(false),
+              prefaceDone(false),
+              closing(false),
+              peerGone(false),
+              goingAway(false) {}
+        ~h2session() = default;
+        h2session(const h2session &) = delete;
+        h2session &operator=(const h2session &) = delete;
+    };
+
+    const char *const h2session::preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+}  // namespace sinksky
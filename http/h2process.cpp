@@ -0,0 +1,628 @@
+#pragma once
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <eventloop.hpp>
+
+#include "h2data.cpp"
+#include "httpdata.cpp"
+
+namespace sinksky {
+    using std::shared_ptr;
+    using std::string;
+    using std::vector;
+
+    // HTTP/2 明文(h2c)处理
+    // 支持先验知识(直接发送连接前言)与HTTP/1.1 Upgrade两种方式
+    // 所有流复用同一个conn,响应体与HTTP/1.1一样来自映射的文件并通过writev发送
+    class h2process {
+      private:
+        static const uint8_t FLAG_END_STREAM = 0x1;
+        static const uint8_t FLAG_ACK = 0x1;
+        static const uint8_t FLAG_END_HEADERS = 0x4;
+        static const uint8_t FLAG_PADDED = 0x8;
+        static const uint8_t FLAG_PRIORITY = 0x20;
+        static const int MAX_IOV_NUM = 64;
+
+        conn<httpdata> const *conndata;
+        h2session *session;
+
+        static uint32_t getUint32(const uint8_t *p) {
+            return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        }
+
+        static void putUint32(string &buf, uint32_t value) {
+            buf.push_back((char)(value >> 24));
+            buf.push_back((char)(value >> 16));
+            buf.push_back((char)(value >> 8));
+            buf.push_back((char)value);
+        }
+
+        static void putFrameHeader(string &buf, size_t len, H2Frame type, uint8_t flags,
+                                   uint32_t id) {
+            buf.push_back((char)(len >> 16));
+            buf.push_back((char)(len >> 8));
+            buf.push_back((char)len);
+            buf.push_back((char)type);
+            buf.push_back((char)flags);
+            putUint32(buf, id & 0x7fffffff);
+        }
+
+        static bool decodeBase64(const string &str, string &out) {
+            uint32_t acc = 0;
+            int bits = 0;
+            for (char ch : str) {
+                int v;
+                if (ch >= 'A' && ch <= 'Z') v = ch - 'A';
+                else if (ch >= 'a' && ch <= 'z') v = ch - 'a' + 26;
+                else if (ch >= '0' && ch <= '9') v = ch - '0' + 52;
+                else if (ch == '-' || ch == '+') v = 62;
+                else if (ch == '_' || ch == '/') v = 63;
+                else if (ch == '=') break;
+                else return false;
+                acc = (acc << 6) | v;
+                bits += 6;
+                if (bits >= 8) {
+                    bits -= 8;
+                    out.push_back((char)(acc >> bits));
+                }
+            }
+            return true;
+        }
+
+        void queue(string frame) {
+            h2segment seg;
+            seg.ptr = nullptr;
+            seg.len = frame.size();
+            seg.owned = std::move(frame);
+            session->outBytes += seg.len;
+            session->out.push_back(std::move(seg));
+        }
+
+        void queueRef(const char *ptr, size_t len, const shared_ptr<h2stream> &ref) {
+            h2segment seg;
+            seg.ptr = ptr;
+            seg.len = len;
+            seg.ref = ref;
+            session->outBytes += len;
+            session->out.push_back(std::move(seg));
+        }
+
+        void sendFrame(H2Frame type, uint8_t flags, uint32_t id, const string &payload) {
+            string frame;
+            putFrameHeader(frame, payload.size(), type, flags, id);
+            frame += payload;
+            queue(std::move(frame));
+        }
+
+        void sendSettings() {
+            string payload;
+            payload.push_back(0x0);
+            payload.push_back(0x3);  // SETTINGS_MAX_CONCURRENT_STREAMS
+            putUint32(payload, h2session::MAX_STREAM_NUM);
+            payload.push_back(0x0);
+            payload.push_back(0x6);  // SETTINGS_MAX_HEADER_LIST_SIZE
+            putUint32(payload, h2session::MAX_HEADER_LIST_SIZE);
+            sendFrame(H2Frame::SETTINGS, 0, 0, payload);
+        }
+
+        void windowUpdate(uint32_t id, uint32_t inc) {
+            string payload;
+            putUint32(payload, inc);
+            sendFrame(H2Frame::WINDOW_UPDATE, 0, id, payload);
+        }
+
+        void rstStream(uint32_t id, H2Error err) {
+            string payload;
+            putUint32(payload, (uint32_t)err);
+            sendFrame(H2Frame::RST_STREAM, 0, id, payload);
+            session->streams.erase(id);
+        }
+
+        // 连接错误,发送GOAWAY后在发送队列清空时关闭连接
+        bool goaway(H2Error err) {
+            string payload;
+            putUint32(payload, session->lastStreamId);
+            putUint32(payload, (uint32_t)err);
+            sendFrame(H2Frame::GOAWAY, 0, 0, payload);
+            session->streams.clear();
+            session->active.clear();
+            session->closing = true;
+            return false;
+        }
+
+        // 优雅关闭: 告知对端已处理到的流,之后的新流被拒绝,对端会在新连接上重试
+        void drain() {
+            string payload;
+            putUint32(payload, session->lastStreamId);
+            putUint32(payload, (uint32_t)H2Error::NO_ERROR);
+            sendFrame(H2Frame::GOAWAY, 0, 0, payload);
+            session->goingAway = true;
+        }
+
+        bool applySettings(const uint8_t *p, size_t len) {
+            if (len % 6 != 0) return goaway(H2Error::FRAME_SIZE_ERROR);
+            for (size_t i = 0; i < len; i += 6) {
+                uint16_t id = (p[i] << 8) | p[i + 1];
+                uint32_t value = getUint32(p + i + 2);
+                if (id == 0x4) {
+                    // SETTINGS_INITIAL_WINDOW_SIZE 对所有已存在的流生效
+                    if (value > 0x7fffffff) return goaway(H2Error::FLOW_CONTROL_ERROR);
+                    int64_t delta = (int64_t)value - session->peerInitialWindow;
+                    for (auto &item : session->streams) item.second->sendWindow += delta;
+                    session->peerInitialWindow = value;
+                } else if (id == 0x5) {
+                    // SETTINGS_MAX_FRAME_SIZE
+                    if (value < 16384 || value > 16777215) return goaway(H2Error::PROTOCOL_ERROR);
+                    session->peerMaxFrameSize = value;
+                }
+            }
+            return true;
+        }
+
+        // 在流上执行静态文件请求,生成响应头并将响应体加入调度
+        void doRequest(const shared_ptr<h2stream> &stream, const string &method,
+                       const string &path) {
+            HttpCode code = HttpCode::BAD_REQUEST;
+            struct stat st;
+            const bundleEntry *asset = nullptr;
+            if (!conndata->op->getLimiter().take(conndata->limit)) {
+                code = HttpCode::TOO_MANY_REQUESTS;
+            } else if (conndata->op->getUpstreams().match(path) != upstreamPool::NO_UPSTREAM) {
+                // 反向代理只支持HTTP/1.1,代理前缀下的路径不能回落到静态文件
+                code = HttpCode::BAD_GATEWAY;
+            } else if (httpdata::assets.loaded()) {
+                if ((method == "GET" || method == "HEAD") && !path.empty() && path[0] == '/') {
+                    asset = httpdata::assets.find(path);
+                    code = asset != nullptr ? HttpCode::ASSET_REQUEST : HttpCode::NO_RESOURCE;
+                }
+            } else if ((method == "GET" || method == "HEAD") && !path.empty() && path[0] == '/') {
+                code = httpdata::openFile(path, &st, &stream->fileAddress);
+                HSHR_TRACE(file_open, INSTANT, conndata->traceId, static_cast<int>(code));
+            }
+            respond(stream, method, code, code == HttpCode::FILE_REQUEST ? st.st_size : 0, asset);
+        }
+
+        // 根据请求结果生成响应头并将响应体加入调度,文件请求时stream->fileAddress已映射
+        void respond(const shared_ptr<h2stream> &stream, const string &method, HttpCode code,
+                     off_t size, const bundleEntry *asset) {
+            int status;
+            switch (code) {
+                case HttpCode::FILE_REQUEST: {
+                    status = 200;
+                    if (size != 0) {
+                        stream->fileLen = size;
+                        stream->body = stream->fileAddress;
+                        stream->bodyLen = size;
+                    } else {
+                        stream->body = "<html><body></body></html>";
+                    }
+                    break;
+                }
+                case HttpCode::ASSET_REQUEST: {
+                    // 直接引用资源包映射,fileAddress保持为空,流结束时不需要解除映射
+                    status = 200;
+                    stream->body = asset->body.len != 0 ? httpdata::assets.slice(asset->body) : "";
+                    stream->bodyLen = asset->body.len;
+                    break;
+                }
+                case HttpCode::NO_RESOURCE: {
+                    status = 404;
+                    stream->body = error_404_form;
+                    break;
+                }
+                case HttpCode::FORBIDDEN_REQUEST: {
+                    status = 403;
+                    stream->body = error_403_form;
+                    break;
+                }
+                case HttpCode::INTERNAL_ERROR: {
+                    status = 500;
+                    stream->body = error_500_form;
+                    break;
+                }
+                case HttpCode::TOO_MANY_REQUESTS: {
+                    status = 429;
+                    stream->body = error_429_form;
+                    break;
+                }
+                case HttpCode::BAD_GATEWAY: {
+                    status = 502;
+                    stream->body = error_502_h2_form;
+                    break;
+                }
+                default: {
+                    status = 400;
+                    stream->body = error_400_form;
+                }
+            }
+            if (stream->bodyLen == 0) stream->bodyLen = strlen(stream->body);
+            stream->headOnly = (method == "HEAD");
+
+            string block;
+            hpackEncoder::encode(block, ":status", std::to_string(status));
+            hpackEncoder::encode(block, "content-length", std::to_string(stream->bodyLen));
+            if (asset != nullptr) {
+                hpackEncoder::encode(block, "etag",
+                                     string(httpdata::assets.slice(asset->etag), asset->etag.len));
+            }
+            uint8_t flags = FLAG_END_HEADERS | (stream->headOnly ? FLAG_END_STREAM : 0);
+            sendFrame(H2Frame::HEADERS, flags, stream->id, block);
+            if (stream->headOnly) {
+                session->streams.erase(stream->id);
+            } else {
+                session->active.push_back(stream->id);
+            }
+        }
+
+        bool headersDone(uint32_t id) {
+            vector<headerField> headers;
+            const uint8_t *block = (const uint8_t *)session->headerBlock.data();
+            // 即使流会被拒绝也必须解码,保持动态表同步
+            size_t listSize;
+            if (!session->decoder.decode(block, session->headerBlock.size(), headers,
+                                         h2session::MAX_HEADER_LIST_SIZE, listSize)) {
+                return goaway(H2Error::COMPRESSION_ERROR);
+            }
+            if (listSize > h2session::MAX_HEADER_LIST_SIZE) {
+                return goaway(H2Error::ENHANCE_YOUR_CALM);
+            }
+            if (id <= session->lastStreamId) {
+                // 已有流上的尾部头部,忽略
+                return true;
+            }
+            session->lastStreamId = id;
+            if (session->goingAway || session->peerGone || session->streams.size() >= h2session::MAX_STREAM_NUM) {
+                rstStream(id, H2Error::REFUSED_STREAM);
+                return true;
+            }
+            auto stream = std::make_shared<h2stream>(id, session->peerInitialWindow);
+            stream->endStream = session->headerEndStream;
+            session->streams[id] = stream;
+
+            string method, path;
+            for (auto &field : headers) {
+                if (field.first == ":method") {
+                    method = field.second;
+                } else if (field.first == ":path") {
+                    path = field.second;
+                }
+            }
+            doRequest(stream, method, path);
+            return true;
+        }
+
+        // 处理一个完整的帧,返回false表示已发送GOAWAY
+        bool handleFrame(H2Frame type, uint8_t flags, uint32_t id, const uint8_t *p, uint32_t len) {
+            if (session->continuationId != 0
+                && (type != H2Frame::CONTINUATION || id != session->continuationId)) {
+                return goaway(H2Error::PROTOCOL_ERROR);
+            }
+            switch (type) {
+                case H2Frame::DATA: {
+                    if (id == 0) return goaway(H2Error::PROTOCOL_ERROR);
+                    // 只处理GET/HEAD,请求体直接丢弃,但要归还流量窗口
+                    auto it = session->streams.find(id);
+                    if (len > 0) {
+                        windowUpdate(0, len);
+                        if (it != session->streams.end() && !(flags & FLAG_END_STREAM)) {
+                            windowUpdate(id, len);
+                        }
+                    }
+                    if (it != session->streams.end() && (flags & FLAG_END_STREAM)) {
+                        it->second->endStream = true;
+                    }
+                    break;
+                }
+                case H2Frame::HEADERS: {
+                    if (id == 0 || id % 2 == 0) return goaway(H2Error::PROTOCOL_ERROR);
+                    size_t off = 0;
+                    size_t padLen = 0;
+                    if (flags & FLAG_PADDED) {
+                        if (len < 1) return goaway(H2Error::PROTOCOL_ERROR);
+                        padLen = p[0];
+                        off = 1;
+                    }
+                    if (flags & FLAG_PRIORITY) off += 5;
+                    if (off + padLen > len) return goaway(H2Error::PROTOCOL_ERROR);
+                    if (len - off - padLen > h2session::MAX_HEADER_LIST_SIZE) {
+                        return goaway(H2Error::ENHANCE_YOUR_CALM);
+                    }
+                    session->headerBlock.assign((const char *)p + off, len - off - padLen);
+                    session->headerEndStream = flags & FLAG_END_STREAM;
+                    if (flags & FLAG_END_HEADERS) return headersDone(id);
+                    session->continuationId = id;
+                    break;
+                }
+                case H2Frame::CONTINUATION: {
+                    if (session->continuationId == 0) return goaway(H2Error::PROTOCOL_ERROR);
+                    // 没有END_HEADERS的CONTINUATION可以无限发送,必须限制头部块的总大小
+                    if (session->headerBlock.size() + len > h2session::MAX_HEADER_LIST_SIZE) {
+                        return goaway(H2Error::ENHANCE_YOUR_CALM);
+                    }
+                    session->headerBlock.append((const char *)p, len);
+                    if (flags & FLAG_END_HEADERS) {
+                        session->continuationId = 0;
+                        return headersDone(id);
+                    }
+                    break;
+                }
+                case H2Frame::PRIORITY: {
+                    if (len != 5) return goaway(H2Error::FRAME_SIZE_ERROR);
+                    break;
+                }
+                case H2Frame::RST_STREAM: {
+                    if (id == 0) return goaway(H2Error::PROTOCOL_ERROR);
+                    if (len != 4) return goaway(H2Error::FRAME_SIZE_ERROR);
+                    session->streams.erase(id);
+                    break;
+                }
+                case H2Frame::SETTINGS: {
+                    if (id != 0) return goaway(H2Error::PROTOCOL_ERROR);
+                    if (flags & FLAG_ACK) {
+                        if (len != 0) return goaway(H2Error::FRAME_SIZE_ERROR);
+                        break;
+                    }
+                    if (!applySettings(p, len)) return false;
+                    sendFrame(H2Frame::SETTINGS, FLAG_ACK, 0, "");
+                    break;
+                }
+                case H2Frame::PUSH_PROMISE: {
+                    return goaway(H2Error::PROTOCOL_ERROR);
+                }
+                case H2Frame::PING: {
+                    if (id != 0) return goaway(H2Error::PROTOCOL_ERROR);
+                    if (len != 8) return goaway(H2Error::FRAME_SIZE_ERROR);
+                    if (!(flags & FLAG_ACK)) {
+                        sendFrame(H2Frame::PING, FLAG_ACK, 0, string((const char *)p, len));
+                    }
+                    break;
+                }
+                case H2Frame::GOAWAY: {
+                    // 对端不再发起新流,继续处理其他帧(如WINDOW_UPDATE),发送完当前的响应后关闭
+                    session->peerGone = true;
+                    break;
+                }
+                case H2Frame::WINDOW_UPDATE: {
+                    if (len != 4) return goaway(H2Error::FRAME_SIZE_ERROR);
+                    uint32_t inc = getUint32(p) & 0x7fffffff;
+                    if (id == 0) {
+                        if (inc == 0) return goaway(H2Error::PROTOCOL_ERROR);
+                        session->sendWindow += inc;
+                        if (session->sendWindow > 0x7fffffff) {
+                            return goaway(H2Error::FLOW_CONTROL_ERROR);
+                        }
+                        break;
+                    }
+                    auto it = session->streams.find(id);
+                    if (it == session->streams.end()) break;
+                    it->second->sendWindow += inc;
+                    if (inc == 0 || it->second->sendWindow > 0x7fffffff) {
+                        rstStream(id, inc == 0 ? H2Error::PROTOCOL_ERROR
+                                               : H2Error::FLOW_CONTROL_ERROR);
+                    }
+                    break;
+                }
+                default: {
+                    // 忽略未知类型的帧
+                }
+            }
+            return true;
+        }
+
+        // 返回false表示连接前言错误,直接关闭连接
+        bool processFrames() {
+            vector<char> &in = session->inBuf;
+            size_t pos = 0;
+            if (!session->prefaceDone) {
+                size_t len = std::min(in.size(), (size_t)h2session::PREFACE_LEN);
+                if (memcmp(in.data(), h2session::preface, len)) return false;
+                if (len < h2session::PREFACE_LEN) return true;
+                pos = h2session::PREFACE_LEN;
+                session->prefaceDone = true;
+            }
+            while (!session->closing && in.size() - pos >= 9) {
+                const uint8_t *p = (const uint8_t *)in.data() + pos;
+                uint32_t len = (p[0] << 16) | (p[1] << 8) | p[2];
+                if (len > h2session::MAX_FRAME_SIZE) {
+                    goaway(H2Error::FRAME_SIZE_ERROR);
+                    break;
+                }
+                if (in.size() - pos < 9 + len) break;
+                if (!handleFrame((H2Frame)p[3], p[4], getUint32(p + 5) & 0x7fffffff, p + 9, len)) {
+                    break;
+                }
+                pos += 9 + len;
+            }
+            in.erase(in.begin(), in.begin() + pos);
+            return true;
+        }
+
+        // 轮转各个流,在流量窗口允许的范围内生成DATA帧
+        // Upgrade后在收到客户端的连接前言之前不发送响应体,避免客户端缓冲区溢出
+        void schedule() {
+            auto &active = session->active;
+            if (!session->prefaceDone) return;
+            size_t blocked = 0;
+            while (!active.empty() && blocked < active.size()
+                   && session->outBytes < h2session::MAX_OUT_SIZE && session->sendWindow > 0) {
+                uint32_t id = active.front();
+                active.pop_front();
+                auto it = session->streams.find(id);
+                if (it == session->streams.end()) continue;
+                shared_ptr<h2stream> stream = it->second;
+                size_t chunk = std::min<size_t>(stream->bodyLen - stream->bodySent,
+                                                session->peerMaxFrameSize);
+                chunk = std::min<size_t>(chunk, session->sendWindow);
+                chunk = std::min<size_t>(chunk, std::max<int64_t>(stream->sendWindow, 0));
+                if (chunk == 0) {
+                    active.push_back(id);
+                    ++blocked;
+                    continue;
+                }
+                blocked = 0;
+                bool last = stream->bodySent + chunk == stream->bodyLen;
+                string header;
+                putFrameHeader(header, chunk, H2Frame::DATA, last ? FLAG_END_STREAM : 0, id);
+                queue(std::move(header));
+                queueRef(stream->body + stream->bodySent, chunk, stream);
+                stream->bodySent += chunk;
+                stream->sendWindow -= chunk;
+                session->sendWindow -= chunk;
+                if (last) {
+                    session->streams.erase(id);
+                } else {
+                    active.push_back(id);
+                }
+            }
+        }
+
+        // 返回false表示连接出错,yield表示本次调度的发送配额已用完
+        bool flush(bool &yield) {
+            auto &out = session->out;
+            size_t sent = 0;
+            auto start = std::chrono::steady_clock::now();
+            yield = false;
+            while (true) {
+                if (sent >= httpdata::sendQuantum
+                    || std::chrono::steady_clock::now() - start >= httpdata::sendTimeQuantum) {
+                    yield = true;
+                    return true;
+                }
+                schedule();
+                if (out.empty()) return true;
+                iovec iov[MAX_IOV_NUM];
+                int iovcnt = 0;
+                for (auto it = out.begin(); it != out.end() && iovcnt < MAX_IOV_NUM; ++it) {
+                    const char *ptr = it->ptr != nullptr ? it->ptr : it->owned.data();
+                    size_t skip = iovcnt == 0 ? session->outSent : 0;
+                    iov[iovcnt].iov_base = (char *)ptr + skip;
+                    iov[iovcnt].iov_len = it->len - skip;
+                    ++iovcnt;
+                }
+                auto cnt = writev(conndata->fd, iov, iovcnt);
+                HSHR_TRACE(writev, INSTANT, conndata->traceId, cnt);
+                if (cnt == -1) {
+                    if (errno == EAGAIN) {
+                        HSHR_TRACE(eagain, INSTANT, conndata->traceId, session->outBytes);
+                        return true;
+                    }
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                session->outBytes -= cnt;
+                sent += cnt;
+                size_t left = cnt;
+                while (left > 0) {
+                    size_t remain = out.front().len - session->outSent;
+                    if (left < remain) {
+                        session->outSent += left;
+                        break;
+                    }
+                    left -= remain;
+                    session->outSent = 0;
+                    out.pop_front();
+                }
+            }
+        }
+
+        bool readSocket() {
+            vector<char> &in = session->inBuf;
+            while (in.size() < h2session::MAX_IN_SIZE) {
+                size_t old = in.size();
+                in.resize(old + h2session::MAX_FRAME_SIZE);
+                auto cnt = recv(conndata->fd, in.data() + old, h2session::MAX_FRAME_SIZE, 0);
+                in.resize(old + std::max<ssize_t>(cnt, 0));
+                if (cnt == -1) {
+                    if (errno == EAGAIN) break;
+                    if (errno == EINTR) continue;
+                    return false;
+                } else if (cnt == 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // 发送完毕后根据状态重新注册事件或关闭连接
+        void finish(bool ok) {
+            bool yield = false;
+            if (ok) ok = flush(yield);
+            if (!ok
+                || ((session->closing || session->goingAway || session->peerGone)
+                    && session->out.empty() && session->active.empty())) {
+                conndata->op->delConnfd(conndata->fd);
+                return;
+            }
+            conndata->op->modConnfd(conndata->fd,
+                                    session->out.empty() && !yield ? EPOLLIN : (EPOLLIN | EPOLLOUT),
+                                    yield);
+        }
+
+      public:
+        h2process(conn<httpdata> const *conndata)
+            : conndata(conndata), session(conndata->data->h2.get()) {}
+        ~h2process() = default;
+        h2process(const h2process &) = delete;
+        h2process &operator=(const h2process &) = delete;
+
+        static bool isPreface(const char *buf, int len) {
+            return len > 0
+                   && !memcmp(buf, h2session::preface, std::min(len, h2session::PREFACE_LEN));
+        }
+
+        // 先验知识: 读缓冲区以连接前言开头
+        void start() {
+            httpdata *data = conndata->data.get();
+            data->h2 = std::make_unique<h2session>();
+            session = data->h2.get();
+            session->inBuf.assign(data->readBuf.get(), data->readBuf.get() + data->readIdx);
+            sendSettings();
+            bool ok = readSocket() && processFrames();
+            finish(ok);
+        }
+
+        // HTTP/1.1 Upgrade: h2c,升级前的请求作为流1的请求,直接使用HTTP/1.1解析时得到的结果
+        void upgrade(HttpCode code) {
+            httpdata *data = conndata->data.get();
+            data->h2 = std::make_unique<h2session>();
+            session = data->h2.get();
+            queue("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+            sendSettings();
+            string settings;
+            if (!decodeBase64(data->h2Settings, settings)
+                || !applySettings((const uint8_t *)settings.data(), settings.size())) {
+                finish(false);
+                return;
+            }
+            auto stream = std::make_shared<h2stream>(1, session->peerInitialWindow);
+            stream->endStream = true;
+            session->streams[1] = stream;
+            session->lastStreamId = 1;
+            // 已映射的文件转交给流,由流负责解除映射
+            stream->fileAddress = data->fileAddress;
+            data->fileAddress = nullptr;
+            respond(stream, data->method == Method::HEAD ? "HEAD" : "GET", code, code == HttpCode::FILE_REQUEST ? data->fileStat.st_size : 0,
+                    data->asset);
+            // 请求之后已读入的数据(如客户端提前发送的连接前言)属于HTTP/2会话
+            session->inBuf.assign(data->readBuf.get() + data->checkedIdx,
+                                  data->readBuf.get() + data->readIdx);
+            bool ok = processFrames();
+            // 读缓冲区已满时套接字中可能还有数据,边缘触发不会再次通知
+            if (ok && data->readIdx >= httpdata::READ_BUF_SIZE) ok = readSocket() && processFrames();
+            finish(ok);
+        }
+
+        void process() {
+            bool ok = true;
+            if (conndata->statu & EPOLLIN) {
+                ok = readSocket() && processFrames();
+            }
+            if (ok && !session->goingAway && conndata->op->isDraining()) drain();
+            finish(ok);
+        }
+    };
+
+}  // namespace sinksky
@@ -0,0 +1,363 @@
+#pragma once
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sinksky {
+    using std::deque;
+    using std::pair;
+    using std::string;
+    using std::vector;
+
+    using headerField = pair<string, string>;
+
+    // RFC 7541 附录A 静态表
+    static const char *const hpackStaticTable[][2] = {
+        {":authority", ""},
+        {":method", "GET"},
+        {":method", "POST"},
+        {":path", "/"},
+        {":path", "/index.html"},
+        {":scheme", "http"},
+        {":scheme", "https"},
+        {":status", "200"},
+        {":status", "204"},
+        {":status", "206"},
+        {":status", "304"},
+        {":status", "400"},
+        {":status", "404"},
+        {":status", "500"},
+        {"accept-charset", ""},
+        {"accept-encoding", "gzip, deflate"},
+        {"accept-language", ""},
+        {"accept-ranges", ""},
+        {"accept", ""},
+        {"access-control-allow-origin", ""},
+        {"age", ""},
+        {"allow", ""},
+        {"authorization", ""},
+        {"cache-control", ""},
+        {"content-disposition", ""},
+        {"content-encoding", ""},
+        {"content-language", ""},
+        {"content-length", ""},
+        {"content-location", ""},
+        {"content-range", ""},
+        {"content-type", ""},
+        {"cookie", ""},
+        {"date", ""},
+        {"etag", ""},
+        {"expect", ""},
+        {"expires", ""},
+        {"from", ""},
+        {"host", ""},
+        {"if-match", ""},
+        {"if-modified-since", ""},
+        {"if-none-match", ""},
+        {"if-range", ""},
+        {"if-unmodified-since", ""},
+        {"last-modified", ""},
+        {"link", ""},
+        {"location", ""},
+        {"max-forwards", ""},
+        {"proxy-authenticate", ""},
+        {"proxy-authorization", ""},
+        {"range", ""},
+        {"referer", ""},
+        {"refresh", ""},
+        {"retry-after", ""},
+        {"server", ""},
+        {"set-cookie", ""},
+        {"strict-transport-security", ""},
+        {"transfer-encoding", ""},
+        {"user-agent", ""},
+        {"vary", ""},
+        {"via", ""},
+        {"www-authenticate", ""},
+    };
+
+    // RFC 7541 附录B Huffman编码表 {编码, 位数}, 下标为符号值, 256为EOS
+    static const uint32_t hpackHuffmanTable[257][2] = {
+        {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+        {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+        {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+        {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+        {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+        {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+        {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+        {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+        {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+        {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+        {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+        {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+        {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+        {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+        {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+        {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+        {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+        {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+        {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+        {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+        {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+        {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+        {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+        {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+        {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+        {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+        {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+        {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+        {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+        {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+        {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+        {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+        {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+        {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+        {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+        {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+        {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+        {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+        {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+        {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+        {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+        {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+        {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+        {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+        {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+        {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+        {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+        {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+        {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+        {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+        {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+        {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+        {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+        {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+        {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+        {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+        {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+        {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+        {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+        {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+        {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+        {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+        {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+        {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+        {0x3fffffff, 30},
+    };
+
+    // HPACK 解码器
+    // 每个HTTP/2连接持有一个,动态表随连接存在
+    class hpackDecoder {
+      private:
+        struct huffNode {
+            int16_t child[2];
+            int16_t sym;
+        };
+
+        size_t maxSize;
+        size_t size;
+        deque<headerField> dynTable;
+
+        // 由编码表构造的解码树,全局只构造一次
+        static const vector<huffNode> &huffmanTree() {
+            static const vector<huffNode> tree = [] {
+                vector<huffNode> t(1, huffNode{{-1, -1}, -1});
+                for (int sym = 0; sym < 257; ++sym) {
+                    uint32_t code = hpackHuffmanTable[sym][0];
+                    int len = hpackHuffmanTable[sym][1];
+                    int cur = 0;
+                    for (int b = len - 1; b >= 0; --b) {
+                        int bit = (code >> b) & 1;
+                        if (t[cur].child[bit] < 0) {
+                            t[cur].child[bit] = t.size();
+                            t.push_back(huffNode{{-1, -1}, -1});
+                        }
+                        cur = t[cur].child[bit];
+                    }
+                    t[cur].sym = sym;
+                }
+                return t;
+            }();
+            return tree;
+        }
+
+        static bool decodeInt(const uint8_t *&p, const uint8_t *end, int prefix, uint64_t &value) {
+            if (p >= end) return false;
+            uint64_t max = (1u << prefix) - 1;
+            value = *p++ & max;
+            if (value < max) return true;
+            for (int shift = 0; p < end && shift <= 28; shift += 7) {
+                uint8_t b = *p++;
+                value += (uint64_t)(b & 0x7f) << shift;
+                if (!(b & 0x80)) return true;
+            }
+            return false;
+        }
+
+        static bool decodeHuffman(const uint8_t *p, size_t len, string &str) {
+            const vector<huffNode> &tree = huffmanTree();
+            int cur = 0;
+            int depth = 0;
+            bool allOnes = true;
+            for (size_t i = 0; i < len; ++i) {
+                for (int b = 7; b >= 0; --b) {
+                    int bit = (p[i] >> b) & 1;
+                    cur = tree[cur].child[bit];
+                    if (cur < 0) return false;
+                    ++depth;
+                    allOnes = allOnes && bit;
+                    if (tree[cur].sym >= 0) {
+                        if (tree[cur].sym == 256) return false;
+                        str.push_back((char)tree[cur].sym);
+                        cur = 0;
+                        depth = 0;
+                        allOnes = true;
+                    }
+                }
+            }
+            // 末尾填充必须是少于8位的EOS前缀(全1)
+            return depth < 8 && allOnes;
+        }
+
+        static bool decodeString(const uint8_t *&p, const uint8_t *end, string &str) {
+            if (p >= end) return false;
+            bool huffman = *p & 0x80;
+            uint64_t len;
+            if (!decodeInt(p, end, 7, len) || len > (uint64_t)(end - p)) return false;
+            str.clear();
+            if (huffman) {
+                if (!decodeHuffman(p, len, str)) return false;
+            } else {
+                str.assign((const char *)p, len);
+            }
+            p += len;
+            return true;
+        }
+
+        void evict(size_t limit) {
+            while (size > limit && !dynTable.empty()) {
+                size -= dynTable.back().first.size() + dynTable.back().second.size() + 32;
+                dynTable.pop_back();
+            }
+        }
+
+        void insert(const headerField &field) {
+            size_t entry = field.first.size() + field.second.size() + 32;
+            evict(entry > maxSize ? 0 : maxSize - entry);
+            if (entry <= maxSize) {
+                dynTable.push_front(field);
+                size += entry;
+            }
+        }
+
+        bool lookup(uint64_t index, headerField &field) {
+            const uint64_t staticNum = sizeof(hpackStaticTable) / sizeof(hpackStaticTable[0]);
+            if (index == 0) return false;
+            if (index <= staticNum) {
+                field.first = hpackStaticTable[index - 1][0];
+                field.second = hpackStaticTable[index - 1][1];
+                return true;
+            }
+            if (index - staticNum > dynTable.size()) return false;
+            field = dynTable[index - staticNum - 1];
+            return true;
+        }
+
+      public:
+        explicit hpackDecoder(size_t maxsize = 4096) : maxSize(maxsize), size(0) {}
+        ~hpackDecoder() = default;
+        hpackDecoder(const hpackDecoder &) = delete;
+        hpackDecoder &operator=(const hpackDecoder &) = delete;
+
+        // 解码一个完整的头部块,失败表示COMPRESSION_ERROR
+        // listSize返回解码后头部列表的大小(RFC 7541 4.1的计法),超过maxListSize后仍继续解码以保持动态表同步,
+        // 但不再保存字段,避免少量引用动态表的索引字段展开成大量内存
+        bool decode(const uint8_t *p, size_t len, vector<headerField> &headers,
+                    size_t maxListSize, size_t &listSize) {
+            const uint8_t *end = p + len;
+            uint64_t index;
+            listSize = 0;
+            auto keep = [&](headerField &field) {
+                listSize += field.first.size() + field.second.size() + 32;
+                if (listSize <= maxListSize) headers.push_back(std::move(field));
+            };
+            while (p < end) {
+                headerField field;
+                if (*p & 0x80) {
+                    // 索引头部字段
+                    if (!decodeInt(p, end, 7, index) || !lookup(index, field)) return false;
+                    keep(field);
+                } else if ((*p & 0xe0) == 0x20) {
+                    // 动态表大小更新
+                    if (!decodeInt(p, end, 5, index) || index > 4096) return false;
+                    maxSize = index;
+                    evict(maxSize);
+                } else {
+                    // 带增量索引(01)/不索引(0000)/永不索引(0001)的字面量
+                    bool indexing = (*p & 0xc0) == 0x40;
+                    if (!decodeInt(p, end, indexing ? 6 : 4, index)) return false;
+                    if (index == 0) {
+                        if (!decodeString(p, end, field.first)) return false;
+                    } else if (!lookup(index, field)) {
+                        return false;
+                    }
+                    if (!decodeString(p, end, field.second)) return false;
+                    if (indexing) insert(field);
+                    keep(field);
+                }
+            }
+            return true;
+        }
+
+        bool decode(const uint8_t *p, size_t len, vector<headerField> &headers) {
+            size_t listSize;
+            return decode(p, len, headers, SIZE_MAX, listSize);
+        }
+    };
+
+    // HPACK 编码器
+    // 响应头只使用静态表与不索引的字面量,不维护动态表,因此对端的表大小设置不影响编码
+    class hpackEncoder {
+      private:
+        static void encodeInt(string &out, uint8_t flag, int prefix, uint64_t value) {
+            uint64_t max = (1u << prefix) - 1;
+            if (value < max) {
+                out.push_back((char)(flag | value));
+                return;
+            }
+            out.push_back((char)(flag | max));
+            value -= max;
+            while (value >= 0x80) {
+                out.push_back((char)(0x80 | (value & 0x7f)));
+                value >>= 7;
+            }
+            out.push_back((char)value);
+        }
+
+        static void encodeString(string &out, const string &str) {
+            encodeInt(out, 0x00, 7, str.size());
+            out += str;
+        }
+
+      public:
+        static void encode(string &out, const string &name, const string &value) {
+            const int staticNum = sizeof(hpackStaticTable) / sizeof(hpackStaticTable[0]);
+            int nameIndex = 0;
+            for (int i = 0; i < staticNum; ++i) {
+                if (name != hpackStaticTable[i][0]) continue;
+                if (value == hpackStaticTable[i][1]) {
+                    encodeInt(out, 0x80, 7, i + 1);
+                    return;
+                }
+                if (nameIndex == 0) nameIndex = i + 1;
+            }
+            encodeInt(out, 0x00, 4, nameIndex);
+            if (nameIndex == 0) encodeString(out, name);
+            encodeString(out, value);
+        }
+    };
+
+}  // namespace sinksky
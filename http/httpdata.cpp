@@ -1,13 +1,22 @@
 #pragma once
+#include <fcntl.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
+#include <unistd.h>
 
+#include <chrono>
+#include <hotrestart.hpp>
 #include <memory>
+#include <string>
+
+#include "bundle.cpp"
+#include "h2data.cpp"
+#include "proxydata.cpp"
 
 namespace sinksky {
-    enum class Method { GET, POST };
+    enum class Method { GET, POST, HEAD, OTHER };
     enum class HttpCode {
         NO_REQUEST,
         BAD_REQUEST,
@@ -15,7 +24,13 @@ namespace sinksky {
         INTERNAL_ERROR,
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
-        NO_RESOURCE
+        NO_RESOURCE,
+        PROXY_REQUEST,
+        BAD_GATEWAY,
+        SERVICE_UNAVAILABLE,
+        TOO_MANY_REQUESTS,
+        LENGTH_REQUIRED,
+        ASSET_REQUEST
     };
     enum class CheckState { CHECK_REQUESTLINE, CHECK_HEADER, CHECK_CONTENT };
     enum class LineState { LINE_OK, LINE_BAD, LINE_OPEN };
@@ -23,45 +38,107 @@ namespace sinksky {
     using std::string;
     using std::unique_ptr;
 
+    const char *ok_200_title = "OK";
+    const char *not_modified_304_title = "Not Modified";
+    const char *error_400_title = "Bad Request";
+    const char *error_400_form
+        = "Your request has bad syntax or is inherently impossible to satisfy.\n";
+    const char *error_403_title = "Forbidden";
+    const char *error_403_form = "You do not have permission to get file from this server.\n";
+    const char *error_404_title = "Not Found";
+    const char *error_404_form = "The requested file was not found on this server.\n";
+    const char *error_411_title = "Length Required";
+    const char *error_411_form = "Request bodies must be sent with Content-Length.\n";
+    const char *error_500_title = "Internal Error";
+    const char *error_500_form = "There was an unusual problem serving the requested file.\n";
+    const char *error_502_title = "Bad Gateway";
+    const char *error_502_form = "The upstream server returned an invalid or no response.\n";
+    const char *error_502_h2_form = "Proxied paths are only served over HTTP/1.1.\n";
+    const char *error_503_title = "Service Unavailable";
+    const char *error_503_form = "Too many connections to the upstream server.\n";
+    const char *error_429_title = "Too Many Requests";
+    const char *error_429_form = "Too many requests from your address, slow down.\n";
+    // 被限流时直接发送的完整响应,不经过解析与组装
+    const char *error_429_response
+        = "HTTP/1.1 429 Too Many Requests\r\n"
+          "Content-Length: 48\r\n"
+          "Retry-After: 1\r\n"
+          "Connection: close\r\n"
+          "\r\n"
+          "Too many requests from your address, slow down.\n";
+
     class httpprocess;
+    class httpbench;
 
     class httpdata {
         friend class httpprocess;
+        friend class h2process;
+        friend class proxyprocess;
+        friend class httpbench;
 
       public:
         static const int READ_BUF_SIZE = 2048;
         static const int WRITE_BUF_SIZE = 2048;
         static const string root;
+        // 加载后替代root,所有静态请求从映射的资源包中响应
+        static bundle assets;
+        // 文件请求的访问计数,热重启时作为预热清单交给新进程
+        static hotPaths hot;
+        static bool countHot;  // 只有开启热重启时才统计访问次数
+        static const size_t PREWARM_BYTES = 512 * 1024 * 1024;
+        // 每次调度最多发送的字节数与时间,超出后连接重新排队
+        static size_t sendQuantum;
+        static std::chrono::microseconds sendTimeQuantum;
 
       private:
         Method method;
 
         unique_ptr<char[]> readBuf;
         int readIdx;
+        int checkedIdx;  // 已解析的完整请求在readBuf中的结尾
         unique_ptr<char[]> writeBuf;
         int writeIdx;
-        int haveWriteIdx;
+        size_t haveWriteIdx;
         char *fileAddress;
         struct stat fileStat;
-        iovec writeIv[2];
+        iovec writeIv[3];
         int writeIvCount;
 
         bool linger;
         string url;
         CheckState checkState;
+        long long contentLength;  // 请求体长度,只有反向代理会转发请求体
+        bool bodyChunked;         // 请求带有Transfer-Encoding
+        bool expectContinue;
+
+        const bundleEntry *asset;
+        bool acceptGzip;
+        string ifNoneMatch;
+
+        bool upgradeH2c;
+        string h2Settings;
+        unique_ptr<h2session> h2;
+        unique_ptr<proxydata> proxy;
 
       public:
         httpdata()
             : method(Method::GET),
               readBuf(std::make_unique<char[]>(READ_BUF_SIZE)),
               readIdx(0),
+              checkedIdx(0),
               writeBuf(std::make_unique<char[]>(WRITE_BUF_SIZE)),
               writeIdx(0),
               haveWriteIdx(0),
               fileAddress(nullptr),
+              writeIvCount(0),
               linger(true),
               checkState(CheckState::CHECK_REQUESTLINE),
-              writeIvCount(0) {}
+              contentLength(0),
+              bodyChunked(false),
+              expectContinue(false),
+              asset(nullptr),
+              acceptGzip(false),
+              upgradeH2c(false) {}
         ~httpdata() {
             if (fileAddress != nullptr) {
                 munmap(fileAddress, fileStat.st_size);
@@ -74,6 +151,56 @@ namespace sinksky {
             fileAddress = (char *)mmap(addr, len, prot, flags, fd, offset);
         }
 
+        // 将root下的url映射到内存,HTTP/1.1与HTTP/2共用
+        static HttpCode openFile(const string &url, struct stat *st, char **address) {
+            string filepath = root + url;
+            *address = nullptr;
+            if (stat(filepath.c_str(), st) < 0) {
+                return HttpCode::NO_RESOURCE;
+            }
+            if (!(st->st_mode & S_IROTH)) {
+                return HttpCode::FORBIDDEN_REQUEST;
+            }
+            if (S_ISDIR(st->st_mode)) {
+                return HttpCode::BAD_REQUEST;
+            }
+            if (st->st_size == 0) {
+                return HttpCode::FILE_REQUEST;
+            }
+            int fd = open(filepath.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return HttpCode::INTERNAL_ERROR;
+            }
+            void *addr = mmap(0, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (addr == MAP_FAILED) {
+                return HttpCode::INTERNAL_ERROR;
+            }
+            *address = (char *)addr;
+            if (countHot) hot.hit(url);
+            return HttpCode::FILE_REQUEST;
+        }
+
+        // 按旧进程的热点清单把文件读入页缓存,并继承访问计数,在开始accept前调用
+        static void prewarm(const string &manifest) {
+            size_t files = 0, bytes = 0;
+            hotPaths::forEach(manifest, [&](const string &url, uint64_t count) {
+                if (url.empty() || url[0] != '/') return;
+                hot.hit(url, count);
+                if (bytes >= PREWARM_BYTES) return;
+                int fd = open((root + url).c_str(), O_RDONLY);
+                if (fd < 0) return;
+                struct stat st;
+                if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+                    readahead(fd, 0, st.st_size);
+                    ++files;
+                    bytes += st.st_size;
+                }
+                close(fd);
+            });
+            fprintf(stderr, "prewarmed %zu files, %zu bytes\n", files, bytes);
+        }
+
         void unmap() {
             if (fileAddress != nullptr) {
                 munmap(fileAddress, fileStat.st_size);
@@ -84,16 +211,30 @@ namespace sinksky {
         void init() {
             method = Method::GET;
             readIdx = 0;
+            checkedIdx = 0;
             writeIdx = 0;
             haveWriteIdx = 0;
             unmap();
             linger = true;
             checkState = CheckState::CHECK_REQUESTLINE;
+            contentLength = 0;
+            bodyChunked = false;
+            expectContinue = false;
+            asset = nullptr;
+            acceptGzip = false;
+            ifNoneMatch.clear();
             writeIvCount = 0;
+            upgradeH2c = false;
+            h2Settings.clear();
             memset(readBuf.get(), '\0', READ_BUF_SIZE);
             memset(writeBuf.get(), '\0', WRITE_BUF_SIZE);
         }
     };
 
     const string httpdata::root("/var/www/html");
+    bundle httpdata::assets;
+    hotPaths httpdata::hot;
+    bool httpdata::countHot = false;
+    size_t httpdata::sendQuantum = 512 * 1024;
+    std::chrono::microseconds httpdata::sendTimeQuantum(5000);
 }  // namespace sinksky
\ No newline at end of file
@@ -1,11 +1,15 @@
+#include <ctype.h>
 #include <errno.h>
+#include <strings.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
 
 #include <eventloop.hpp>
 #include <regex>
 
+#include "h2process.cpp"
 #include "httpdata.cpp"
+#include "proxyprocess.cpp"
 
 namespace sinksky {
     using std::cmatch;
@@ -13,18 +17,12 @@ namespace sinksky {
     using std::smatch;
     using std::string;
 
-    const char *ok_200_title = "OK";
-    const char *error_400_title = "Bad Request";
-    const char *error_400_form
-        = "Your request has bad syntax or is inherently impossible to satisfy.\n";
-    const char *error_403_title = "Forbidden";
-    const char *error_403_form = "You do not have permission to get file from this server.\n";
-    const char *error_404_title = "Not Found";
-    const char *error_404_form = "The requested file was not found on this server.\n";
-    const char *error_500_title = "Internal Error";
-    const char *error_500_form = "There was an unusual problem serving the requested file.\n";
+    class httpbench;
 
     class httpprocess {
+        // 组件基准测试需要直接调用解析与响应组装
+        friend class httpbench;
+
       private:
         conn<httpdata> const *conndata;
 
@@ -42,17 +40,65 @@ namespace sinksky {
             }
         }
 
+        // 取出头部值中逗号分隔的各个元素,去掉首尾空白
+        static vector<string> splitList(const char *value) {
+            vector<string> items;
+            const char *p = value;
+            while (*p != '\0') {
+                const char *end = strchr(p, ',');
+                if (end == nullptr) end = p + strlen(p);
+                const char *first = p, *last = end;
+                while (first < last && isspace((unsigned char)*first)) ++first;
+                while (last > first && isspace((unsigned char)last[-1])) --last;
+                if (first < last) items.emplace_back(first, last);
+                p = *end == ',' ? end + 1 : end;
+            }
+            return items;
+        }
+
+        // Accept-Encoding中gzip(或*)的q值大于0时才发送预压缩版本,明确列出的gzip优先于*
+        static bool gzipAccepted(const char *value) {
+            double gzipQ = -1, anyQ = -1;
+            for (auto &item : splitList(value)) {
+                size_t semi = item.find(';');
+                string coding = item.substr(0, semi);
+                while (!coding.empty() && isspace((unsigned char)coding.back())) coding.pop_back();
+                double q = 1;
+                while (semi != string::npos) {
+                    size_t next = item.find(';', semi + 1);
+                    string param = item.substr(semi + 1, next == string::npos ? next : next - semi - 1);
+                    size_t first = param.find_first_not_of(" \t");
+                    if (first != string::npos && !strncasecmp(param.c_str() + first, "q=", 2)) {
+                        q = atof(param.c_str() + first + 2);
+                    }
+                    semi = next;
+                }
+                if (!strcasecmp(coding.c_str(), "gzip") || !strcasecmp(coding.c_str(), "x-gzip")) {
+                    gzipQ = q;
+                } else if (coding == "*") {
+                    anyQ = q;
+                }
+            }
+            return gzipQ >= 0 ? gzipQ > 0 : anyQ > 0;
+        }
+
         HttpCode parseRequestLine(const char *str) {
             httpdata *data = conndata->data.get();
             cmatch match;
-            if (!std::regex_search(str, match, regex("^.*? "))) {
+            if (!std::regex_search(str, match, regex("^[A-Z]+ "))) {
                 return HttpCode::BAD_REQUEST;
             }
             str = match[0].second;
-            if (!match[0].str().compare(0, sizeof("GET") - 1, "GET")) {
+            // 静态文件只支持GET,其他方法只有反向代理时原样转发
+            string method = match[0].str().substr(0, match[0].length() - 1);
+            if (method == "GET") {
                 data->method = Method::GET;
+            } else if (method == "POST") {
+                data->method = Method::POST;
+            } else if (method == "HEAD") {
+                data->method = Method::HEAD;
             } else {
-                return HttpCode::BAD_REQUEST;
+                data->method = Method::OTHER;
             }
 
             if (!std::regex_search(str, match, regex("^.*? "))) {
@@ -83,6 +129,33 @@ namespace sinksky {
                 if (!std::regex_search(str, regex("keep-alive\\r\\n$",std::regex::icase))) {
                     data->linger = data->linger && false;
                 }
+            } else if (std::regex_search(str, regex("^Upgrade:", std::regex::icase))) {
+                for (auto &item : splitList(str + sizeof("Upgrade:") - 1)) {
+                    if (!strcasecmp(item.c_str(), "h2c")) data->upgradeH2c = true;
+                }
+            } else if (!strncasecmp(str, "Accept-Encoding:", sizeof("Accept-Encoding:") - 1)) {
+                data->acceptGzip = gzipAccepted(str + sizeof("Accept-Encoding:") - 1);
+            } else if (!strncasecmp(str, "Content-Length:", sizeof("Content-Length:") - 1)) {
+                const char *value = str + sizeof("Content-Length:") - 1;
+                while (*value == ' ' || *value == '\t') ++value;
+                char *end;
+                errno = 0;
+                data->contentLength = strtoll(value, &end, 10);
+                while (*end == ' ' || *end == '\t') ++end;
+                if (!isdigit((unsigned char)*value) || errno != 0 || strcmp(end, "\r\n")) {
+                    return HttpCode::BAD_REQUEST;
+                }
+            } else if (!strncasecmp(str, "Transfer-Encoding:", sizeof("Transfer-Encoding:") - 1)) {
+                data->bodyChunked = true;
+            } else if (!strncasecmp(str, "Expect:", sizeof("Expect:") - 1)) {
+                data->expectContinue = strcasestr(str, "100-continue") != nullptr;
+            } else if (!strncasecmp(str, "If-None-Match:", sizeof("If-None-Match:") - 1)) {
+                data->ifNoneMatch = str + sizeof("If-None-Match:") - 1;
+            } else if (std::regex_search(str, regex("^HTTP2-Settings:", std::regex::icase))) {
+                cmatch match;
+                if (std::regex_search(str, match, regex("^.*?:\\s*([A-Za-z0-9_=-]*)"))) {
+                    data->h2Settings = match[1].str();
+                }
             } else {
                 // TODO 其他字段
             }
@@ -95,23 +168,39 @@ namespace sinksky {
 
         HttpCode doRequest() {
             httpdata *data = conndata->data.get();
-            string filepath = httpdata::root + data->url;
-            if (stat(filepath.c_str(), &(data->fileStat)) < 0) {
-                return HttpCode::NO_RESOURCE;
-            }
-            if (!(data->fileStat.st_mode & S_IROTH)) {
-                return HttpCode::FORBIDDEN_REQUEST;
+            if (conndata->op != nullptr
+                && conndata->op->getUpstreams().match(data->url) != upstreamPool::NO_UPSTREAM) {
+                // 只转发带Content-Length的请求体,未读的chunked请求体使连接无法继续使用
+                if (data->bodyChunked) {
+                    data->linger = false;
+                    return HttpCode::LENGTH_REQUIRED;
+                }
+                return HttpCode::PROXY_REQUEST;
             }
-            if (S_ISDIR(data->fileStat.st_mode)) {
+            if (data->method != Method::GET && data->method != Method::HEAD) {
+                data->linger = false;
                 return HttpCode::BAD_REQUEST;
             }
-            int fd = open(filepath.c_str(), O_RDONLY);
-            data->map(0, data->fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-            close(fd);
-            return HttpCode::FILE_REQUEST;
+            if (httpdata::assets.loaded()) {
+                data->asset = httpdata::assets.find(data->url);
+                HSHR_TRACE(file_open, INSTANT, conndata->traceId, data->asset != nullptr);
+                return data->asset != nullptr ? HttpCode::ASSET_REQUEST : HttpCode::NO_RESOURCE;
+            }
+            HttpCode ret = httpdata::openFile(data->url, &data->fileStat, &data->fileAddress);
+            HSHR_TRACE(file_open, INSTANT, conndata->traceId, static_cast<int>(ret));
+            return ret;
         }
 
         HttpCode processRead() {
+            HSHR_TRACE(parse_start, BEGIN, conndata->traceId, conndata->data->readIdx);
+            HttpCode ret = parseRequest();
+            HSHR_TRACE(parse_end, END, conndata->traceId, static_cast<int>(ret));
+            if (ret == HttpCode::GET_REQUEST) ret = doRequest();
+            return ret;
+        }
+
+        // 只解析请求行与头部,头部完整时返回GET_REQUEST,由processRead查找资源
+        HttpCode parseRequest() {
             httpdata *data = conndata->data.get();
             LineState lineState = LineState::LINE_OK;
             HttpCode ret = HttpCode::NO_REQUEST;
@@ -131,7 +220,8 @@ namespace sinksky {
                         if (ret == HttpCode::BAD_REQUEST) {
                             return HttpCode::BAD_REQUEST;
                         } else if (ret == HttpCode::GET_REQUEST) {
-                            return doRequest();
+                            data->checkedIdx = text - data->readBuf.get();
+                            return HttpCode::GET_REQUEST;
                         }
                         break;
                     }
@@ -166,7 +256,7 @@ namespace sinksky {
             addResponse("%s %d %s\r\n", "HTTP/1.1", status, title);
         }
 
-        void addContentLength(int len) { addResponse("Content-Length: %d\r\n", len); }
+        void addContentLength(long long len) { addResponse("Content-Length: %lld\r\n", len); }
 
         void addLinger() {
             addResponse("Connection: %s\r\n",
@@ -175,7 +265,7 @@ namespace sinksky {
 
         void addBlackLine() { addResponse("%s", "\r\n"); }
 
-        void addHearders(int len) {
+        void addHearders(long long len) {
             addContentLength(len);
             addLinger();
             addBlackLine();
@@ -210,6 +300,73 @@ namespace sinksky {
                     addContent(error_403_form);
                     break;
                 }
+                case HttpCode::BAD_GATEWAY: {
+                    addStatusLine(502, error_502_title);
+                    addHearders(strlen(error_502_form));
+                    addContent(error_502_form);
+                    break;
+                }
+                case HttpCode::SERVICE_UNAVAILABLE: {
+                    addStatusLine(503, error_503_title);
+                    addHearders(strlen(error_503_form));
+                    addContent(error_503_form);
+                    break;
+                }
+                case HttpCode::TOO_MANY_REQUESTS: {
+                    // 通常由reject()直接发送,这里保证任何路径上的429都关闭连接
+                    data->linger = false;
+                    addStatusLine(429, error_429_title);
+                    addResponse("Retry-After: 1\r\n");
+                    addHearders(strlen(error_429_form));
+                    addContent(error_429_form);
+                    break;
+                }
+                case HttpCode::LENGTH_REQUIRED: {
+                    addStatusLine(411, error_411_title);
+                    addHearders(strlen(error_411_form));
+                    addContent(error_411_form);
+                    break;
+                }
+                case HttpCode::NO_REQUEST:
+                case HttpCode::GET_REQUEST:
+                case HttpCode::PROXY_REQUEST: {
+                    // 中间状态,已由processRead与proxyprocess处理,不会生成响应
+                    break;
+                }
+                case HttpCode::ASSET_REQUEST: {
+                    // 响应头与响应体都是资源包映射中的切片,只有Connection需要按请求生成
+                    const bundleEntry *e = data->asset;
+                    const bundle &assets = httpdata::assets;
+                    bool gzip = data->acceptGzip && e->gzipBody.len != 0;
+                    // 两种表示的ETag都可以用于协商,304返回本次会选择的表示的ETag
+                    const string &tags = data->ifNoneMatch;
+                    if (!tags.empty()
+                        && (tags.find(assets.slice(e->etag), 0, e->etag.len) != string::npos
+                            || (e->gzipEtag.len != 0
+                                && tags.find(assets.slice(e->gzipEtag), 0, e->gzipEtag.len)
+                                       != string::npos)
+                            || tags.find('*') != string::npos)) {
+                        const bundleSlice &etag = gzip ? e->gzipEtag : e->etag;
+                        addStatusLine(304, not_modified_304_title);
+                        addResponse("ETag: %.*s\r\n", (int)etag.len, assets.slice(etag));
+                        if (e->gzipBody.len != 0) addResponse("Vary: Accept-Encoding\r\n");
+                        addLinger();
+                        addBlackLine();
+                        break;
+                    }
+                    const bundleSlice &head = gzip ? e->gzipHead : e->head;
+                    const bundleSlice &body = gzip ? e->gzipBody : e->body;
+                    addLinger();
+                    addBlackLine();
+                    data->writeIv[0].iov_base = (void *)assets.slice(head);
+                    data->writeIv[0].iov_len = head.len;
+                    data->writeIv[1].iov_base = data->writeBuf.get();
+                    data->writeIv[1].iov_len = data->writeIdx;
+                    data->writeIv[2].iov_base = (void *)assets.slice(body);
+                    data->writeIv[2].iov_len = body.len;
+                    data->writeIvCount = 3;
+                    return;
+                }
                 case HttpCode::FILE_REQUEST: {
                     addStatusLine(200, ok_200_title);
                     if (data->fileStat.st_size != 0) {
@@ -232,6 +389,20 @@ namespace sinksky {
             data->writeIvCount = 1;
         }
 
+        // HEAD请求只发送响应头,截断到头部结尾的空行
+        void dropBody() {
+            httpdata *data = conndata->data.get();
+            for (int i = 0; i < data->writeIvCount; ++i) {
+                const char *p = (const char *)data->writeIv[i].iov_base;
+                auto end = (const char *)memmem(p, data->writeIv[i].iov_len, "\r\n\r\n", 4);
+                if (end != nullptr) {
+                    data->writeIv[i].iov_len = end + 4 - p;
+                    data->writeIvCount = i + 1;
+                    return;
+                }
+            }
+        }
+
         bool readBuf() {
             httpdata *data = conndata->data.get();
             if (data->readIdx >= httpdata::READ_BUF_SIZE) {
@@ -250,6 +421,7 @@ namespace sinksky {
                     break;
                 } else {
                     data->readIdx += cnt;
+                    if (data->readIdx >= httpdata::READ_BUF_SIZE) break;
                 }
             }
             return true;
@@ -258,7 +430,7 @@ namespace sinksky {
         void adjustIov(iovec iov[], int &iovcnt) {
             httpdata *data = conndata->data.get();
             iovcnt = 0;
-            int done = data->haveWriteIdx;
+            size_t done = data->haveWriteIdx;
             for (int i = 0; i < data->writeIvCount; ++i) {
                 if (done >= data->writeIv[i].iov_len) {
                     done -= data->writeIv[i].iov_len;
@@ -271,26 +443,37 @@ namespace sinksky {
             }
         }
 
+        // 每次调度最多发送一个配额,大文件分多次调度发送,不会长时间占用工作线程
         void writeBuf() {
-            // TODO 修改haveWriteIdx
             httpdata *data = conndata->data.get();
-            int sum = 0;
+            size_t sum = 0;
             for (int i = 0; i < data->writeIvCount; ++i) sum += data->writeIv[i].iov_len;
+            size_t sent = 0;
+            auto start = std::chrono::steady_clock::now();
             while (true) {
-                iovec iov[2];
+                iovec iov[3];
                 int iovcnt;
                 adjustIov(iov, iovcnt);
                 auto cnt = writev(conndata->fd, iov, iovcnt);
+                HSHR_TRACE(writev, INSTANT, conndata->traceId, cnt);
                 if (cnt == -1) {
                     if (errno == EAGAIN) {
-                        conndata->op->modConnfd(conndata->fd, EPOLLOUT);
+                        HSHR_TRACE(eagain, INSTANT, conndata->traceId, data->haveWriteIdx);
+                        conndata->op->modConnfd(
+                            conndata->fd, EPOLLOUT,
+                            sum - data->haveWriteIdx > httpdata::sendQuantum);
                         return;
                     }
+                    if (errno == EINTR) continue;
+                    conndata->op->delConnfd(conndata->fd);
+                    return;
                 }
                 data->haveWriteIdx += cnt;
+                sent += cnt;
                 if (data->haveWriteIdx >= sum) {
                     data->unmap();
-                    if (data->linger) {
+                    // 交接后空闲的长连接也在这里关闭
+                    if (data->linger && !conndata->op->isDraining()) {
                         data->init();
                         conndata->op->modConnfd(conndata->fd, EPOLLIN);
                     } else {
@@ -298,6 +481,12 @@ namespace sinksky {
                     }
                     return;
                 }
+                if (sent >= httpdata::sendQuantum
+                    || std::chrono::steady_clock::now() - start >= httpdata::sendTimeQuantum) {
+                    // 配额用完,以大流量类别重新排队,让小响应优先
+                    conndata->op->modConnfd(conndata->fd, EPOLLOUT, true);
+                    return;
+                }
             }
         }
 
@@ -307,14 +496,60 @@ namespace sinksky {
         httpprocess(const httpprocess &) = delete;
         httpprocess &operator=(const httpprocess &) = delete;
 
+        // 超过来源IP的请求速率,发送预先生成的429后关闭连接
+        void reject() {
+            HSHR_TRACE(limit_request, INSTANT, conndata->traceId, conndata->fd);
+            send(conndata->fd, error_429_response, strlen(error_429_response),
+                 MSG_NOSIGNAL | MSG_DONTWAIT);
+            conndata->op->delConnfd(conndata->fd);
+        }
+
+        // 反向代理失败时向客户端发送错误响应
+        void respond(HttpCode code) {
+            processWrite(code);
+            writeBuf();
+        }
+
         void process() {
+            if (conndata->upstream >= 0) {
+                conn<httpdata> *client = conndata->peer;
+                HttpCode code = proxyprocess(client).onUpstream(conndata->statu);
+                if (code != HttpCode::NO_REQUEST) httpprocess(client).respond(code);
+                return;
+            }
+            httpdata *data = conndata->data.get();
+            if (data->proxy) {
+                HttpCode code = proxyprocess(conndata).onClient();
+                if (code != HttpCode::NO_REQUEST) respond(code);
+                return;
+            }
+            if (data->h2) {
+                h2process(conndata).process();
+                return;
+            }
             if (conndata->statu & EPOLLIN) {
                 bool ret = readBuf();
                 if (!ret) {
                     conndata->op->delConnfd(conndata->fd);
                     return;
+                } else if (h2process::isPreface(data->readBuf.get(), data->readIdx)) {
+                    h2process(conndata).start();
+                } else if (!conndata->op->getLimiter().take(conndata->limit)) {
+                    reject();
                 } else {
-                    processWrite(processRead());
+                    HttpCode code = processRead();
+                    if (code == HttpCode::PROXY_REQUEST) {
+                        int index = conndata->op->getUpstreams().match(data->url);
+                        code = proxyprocess(conndata).start(index);
+                        if (code == HttpCode::NO_REQUEST) return;
+                    } else if (data->upgradeH2c && code != HttpCode::BAD_REQUEST) {
+                        h2process(conndata).upgrade(code);
+                        return;
+                    }
+                    // 旧进程交接后不再保持长连接,客户端重连到新进程
+                    if (conndata->op->isDraining()) data->linger = false;
+                    processWrite(code);
+                    if (data->method == Method::HEAD) dropBody();
                     writeBuf();
                 }
             } else if (conndata->statu & EPOLLOUT) {
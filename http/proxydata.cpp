@@ -0,0 +1,81 @@
+#pragma once
+#include <unistd.h>
+
+#include <string>
+
+namespace sinksky {
+    using std::string;
+
+    // 上游响应体的结束方式
+    enum class BodyMode { NONE, LENGTH, CHUNKED, EOF_CLOSE };
+    enum class ChunkState { SIZE, EXT, SIZE_LF, DATA, DATA_CR, DATA_LF, TRAILER, TRAILER_LF };
+
+    class proxyprocess;
+
+    // 一次反向代理请求的状态,保存在客户端连接的httpdata中
+    // 同一时刻客户端与上游连接只有一方注册在epoll中,所以不需要加锁
+    class proxydata {
+        friend class proxyprocess;
+
+      public:
+        static const size_t MAX_HEAD_SIZE = 16 * 1024;
+        static const size_t RELAY_BUF_SIZE = 64 * 1024;
+
+      private:
+        int index;  // 上游编号
+        int ufd;
+        bool fresh;     // 新建立的连接,需要检查connect结果
+        bool retried;   // 复用的连接失效后已重试过一次
+        bool received;  // 已收到上游响应的字节
+        string request;
+        size_t requestSent;
+        long long bodyRemaining;  // 尚未从客户端读出的请求体字节
+        bool streamed;            // 已从客户端读出请求体,请求无法重发
+
+        string head;  // 上游响应头
+        bool headDone;
+        int status;
+        BodyMode mode;
+        long long remaining;  // LENGTH模式剩余字节,CHUNKED模式当前块剩余字节
+        ChunkState chunk;
+        bool chunkLineEmpty;
+        bool bodyDone;
+        bool reusable;  // 响应结束后上游连接可放回池中
+
+        string out;  // 待发给客户端的数据
+        size_t outSent;
+        int pipefd[2];  // splice中转管道
+        size_t pipeLen;
+
+      public:
+        proxydata(int index)
+            : index(index),
+              ufd(-1),
+              fresh(false),
+              retried(false),
+              received(false),
+              requestSent(0),
+              bodyRemaining(0),
+              streamed(false),
+              headDone(false),
+              status(0),
+              mode(BodyMode::NONE),
+              remaining(0),
+              chunk(ChunkState::SIZE),
+              chunkLineEmpty(true),
+              bodyDone(false),
+              reusable(true),
+              outSent(0),
+              pipefd{-1, -1},
+              pipeLen(0) {}
+        ~proxydata() {
+            if (pipefd[0] >= 0) close(pipefd[0]);
+            if (pipefd[1] >= 0) close(pipefd[1]);
+        }
+        proxydata(const proxydata &) = delete;
+        proxydata &operator=(const proxydata &) = delete;
+
+        bool requestDone() { return requestSent == request.size() && bodyRemaining == 0; }
+    };
+
+}  // namespace sinksky
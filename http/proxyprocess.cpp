@@ -0,0 +1,511 @@
+#pragma once
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <chrono>
+#include <eventloop.hpp>
+#include <upstream.hpp>
+
+#include "httpdata.cpp"
+#include "proxydata.cpp"
+
+namespace sinksky {
+    using std::string;
+
+    // 反向代理处理
+    // 把请求头改写后连同Content-Length请求体转发给上游,响应头改写状态行与Connection后转发给客户端
+    // Content-Length响应体经管道splice转发,chunked与读到关闭为止的响应体经用户态缓冲转发
+    // 返回NO_REQUEST表示已处理完本次事件,否则由httpprocess向客户端发送对应的错误响应
+    class proxyprocess {
+      private:
+        static const long long SPLICE_MIN = 16 * 1024;  // 剩余响应体不足时不值得建立管道
+        static const size_t PIPE_SIZE = 64 * 1024;
+
+        conn<httpdata> const *client;
+        httpdata *data;
+        proxydata *proxy;
+
+        static bool isHeader(const string &line, const char *name) {
+            size_t len = strlen(name);
+            return line.size() > len && line[len] == ':' && !strncasecmp(line.c_str(), name, len);
+        }
+
+        static string headerValue(const string &line) {
+            size_t pos = line.find(':') + 1;
+            while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t')) ++pos;
+            return line.substr(pos);
+        }
+
+        static bool hopByHop(const string &line) {
+            return isHeader(line, "Connection") || isHeader(line, "Keep-Alive")
+                   || isHeader(line, "Proxy-Connection") || isHeader(line, "Upgrade")
+                   || isHeader(line, "HTTP2-Settings") || isHeader(line, "TE")
+                   || isHeader(line, "Expect");
+        }
+
+        // 客户端连接选项只对本跳有效,发往上游的请求统一使用长连接
+        // 已读入readBuf的请求体随请求头一起发送,其余部分之后从客户端读出转发
+        void buildRequest() {
+            string head(data->readBuf.get(), data->readIdx);
+            head.resize(head.find("\r\n\r\n") + 2);
+            size_t pos = 0;
+            while (pos < head.size()) {
+                size_t end = head.find("\r\n", pos);
+                string line = head.substr(pos, end - pos);
+                if (pos == 0 || !hopByHop(line)) {
+                    proxy->request += line;
+                    proxy->request += "\r\n";
+                }
+                pos = end + 2;
+            }
+            proxy->request += "Connection: keep-alive\r\n\r\n";
+            long long have = std::min<long long>(data->readIdx - data->checkedIdx, data->contentLength);
+            proxy->request.append(data->readBuf.get() + data->checkedIdx, have);
+            proxy->bodyRemaining = data->contentLength - have;
+        }
+
+        bool bulk() {
+            return proxy->mode != BodyMode::LENGTH || proxy->remaining > (long long)httpdata::sendQuantum;
+        }
+
+        HttpCode armClient(bool isBulk) {
+            client->op->modConnfd(client->fd, EPOLLOUT, isBulk);
+            return HttpCode::NO_REQUEST;
+        }
+
+        HttpCode armUpstream(int ev) {
+            client->op->modConnfd(proxy->ufd, ev, ev == EPOLLIN && bulk());
+            return HttpCode::NO_REQUEST;
+        }
+
+        // 等待客户端发送剩余的请求体
+        HttpCode awaitBody() {
+            client->op->modConnfd(client->fd, EPOLLIN);
+            return HttpCode::NO_REQUEST;
+        }
+
+        // 放弃代理,由httpprocess发送错误响应,客户端还有未读的请求体时之后关闭连接
+        HttpCode giveUp(HttpCode code) {
+            if (proxy->bodyRemaining > 0) data->linger = false;
+            data->proxy.reset();
+            return code;
+        }
+
+        // 返回1表示发送完毕,0表示需等待可写,-1表示出错
+        int sendRequest() {
+            while (proxy->requestSent < proxy->request.size()) {
+                auto cnt = send(proxy->ufd, proxy->request.data() + proxy->requestSent,
+                                proxy->request.size() - proxy->requestSent, MSG_NOSIGNAL);
+                if (cnt == -1) {
+                    if (errno == EAGAIN) return 0;
+                    if (errno == EINTR) continue;
+                    return -1;
+                }
+                proxy->requestSent += cnt;
+            }
+            return 1;
+        }
+
+        // 复用的连接可能已被上游关闭,尚未收到任何响应字节时重新建立连接重试一次
+        HttpCode connectUpstream() {
+            auto &pool = client->op->getUpstreams();
+            int fd = pool.acquire(proxy->index, proxy->fresh);
+            if (fd == upstreamPool::LIMIT_REACHED) {
+                return giveUp(HttpCode::SERVICE_UNAVAILABLE);
+            } else if (fd < 0) {
+                return giveUp(HttpCode::BAD_GATEWAY);
+            }
+            proxy->ufd = fd;
+            HSHR_TRACE(upstream_connect, INSTANT, client->traceId, proxy->fresh);
+            int ev = EPOLLOUT;
+            if (!proxy->fresh) {
+                int ret = sendRequest();
+                if (ret < 0) {
+                    close(fd);
+                    pool.closed(proxy->index);
+                    return retry(HttpCode::BAD_GATEWAY);
+                }
+                ev = ret && proxy->bodyRemaining == 0 ? EPOLLIN : EPOLLOUT;
+            }
+            client->op->addUpstreamfd(fd, proxy->index, client->fd, ev);
+            return HttpCode::NO_REQUEST;
+        }
+
+        HttpCode retry(HttpCode code) {
+            if (proxy->fresh || proxy->retried || proxy->received || proxy->streamed) {
+                return giveUp(code);
+            }
+            int index = proxy->index;
+            string request = std::move(proxy->request);
+            long long bodyRemaining = proxy->bodyRemaining;
+            data->proxy = std::make_unique<proxydata>(index);
+            proxy = data->proxy.get();
+            proxy->request = std::move(request);
+            proxy->bodyRemaining = bodyRemaining;
+            proxy->retried = true;
+            return connectUpstream();
+        }
+
+        void dropUpstream() {
+            client->op->unlinkPeer(proxy->ufd);
+            client->op->delConnfd(proxy->ufd);
+        }
+
+        // 关闭客户端连接,上游连接随之关闭
+        HttpCode closeClient() {
+            data->proxy.reset();
+            client->op->delConnfd(client->fd);
+            return HttpCode::NO_REQUEST;
+        }
+
+        // 响应头已转发后出错只能关闭客户端连接
+        HttpCode fail(HttpCode code) {
+            if (proxy->headDone) return closeClient();
+            dropUpstream();
+            return retry(code);
+        }
+
+        // 在请求体发完之前上游连接只注册可写,需要读客户端时改为注册客户端连接
+        HttpCode forward() {
+            while (true) {
+                int ret = sendRequest();
+                if (ret < 0) return fail(HttpCode::BAD_GATEWAY);
+                if (ret == 0) return armUpstream(EPOLLOUT);
+                if (proxy->bodyRemaining == 0) return armUpstream(EPOLLIN);
+                char buf[16384];
+                auto cnt = recv(client->fd, buf, std::min<long long>(proxy->bodyRemaining, sizeof(buf)),
+                                0);
+                if (cnt == -1) {
+                    if (errno == EAGAIN) return awaitBody();
+                    if (errno == EINTR) continue;
+                    return closeClient();
+                } else if (cnt == 0) {
+                    return closeClient();
+                }
+                proxy->streamed = true;
+                proxy->request.assign(buf, cnt);
+                proxy->requestSent = 0;
+                proxy->bodyRemaining -= cnt;
+            }
+        }
+
+        bool parseHead() {
+            const string &head = proxy->head;
+            size_t end = head.find("\r\n");
+            string line = head.substr(0, end);
+            if (line.compare(0, sizeof("HTTP/1.") - 1, "HTTP/1.") || line.size() < 12 || line[8] != ' '
+                || !isdigit(line[9]) || !isdigit(line[10]) || !isdigit(line[11])) {
+                return false;
+            }
+            if (line[7] == '0') proxy->reusable = false;
+            proxy->status = atoi(line.c_str() + 9);
+            // 状态行由代理生成,上游的协议版本不影响客户端后续请求
+            string out = "HTTP/1.1 " + line.substr(9, 3) + " "
+                         + (line.size() > 13 ? line.substr(13) : "") + "\r\n";
+
+            long long length = -1;
+            bool chunked = false;
+            size_t pos = end + 2;
+            while (pos < head.size() - 2) {
+                end = head.find("\r\n", pos);
+                line = head.substr(pos, end - pos);
+                pos = end + 2;
+                if (isHeader(line, "Connection")) {
+                    if (strcasestr(line.c_str(), "close")) proxy->reusable = false;
+                    continue;
+                } else if (isHeader(line, "Keep-Alive") || isHeader(line, "Proxy-Connection")) {
+                    continue;
+                } else if (isHeader(line, "Content-Length")) {
+                    length = atoll(headerValue(line).c_str());
+                } else if (isHeader(line, "Transfer-Encoding")) {
+                    chunked = strcasestr(line.c_str(), "chunked") != nullptr;
+                }
+                out += line;
+                out += "\r\n";
+            }
+
+            if (data->method == Method::HEAD || proxy->status / 100 == 1 || proxy->status == 204
+                || proxy->status == 304) {
+                proxy->mode = BodyMode::NONE;
+            } else if (chunked) {
+                proxy->mode = BodyMode::CHUNKED;
+            } else if (length >= 0) {
+                proxy->mode = length > 0 ? BodyMode::LENGTH : BodyMode::NONE;
+                proxy->remaining = length;
+            } else {
+                // 没有长度信息,响应体以上游关闭连接结束,客户端连接也只能关闭
+                proxy->mode = BodyMode::EOF_CLOSE;
+                proxy->reusable = false;
+                data->linger = false;
+            }
+            proxy->bodyDone = proxy->mode == BodyMode::NONE;
+            if (client->op->isDraining()) data->linger = false;
+            out += data->linger ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+            proxy->out = std::move(out);
+            proxy->headDone = true;
+            return true;
+        }
+
+        // 只跟踪chunked编码的边界,数据原样转发
+        bool parseChunk(const char *p, size_t len, size_t &used) {
+            size_t i = 0;
+            while (i < len && !proxy->bodyDone) {
+                char ch = p[i];
+                switch (proxy->chunk) {
+                    case ChunkState::SIZE: {
+                        int v = isdigit(ch) ? ch - '0'
+                                : (ch >= 'a' && ch <= 'f') ? ch - 'a' + 10
+                                : (ch >= 'A' && ch <= 'F') ? ch - 'A' + 10
+                                                           : -1;
+                        if (v >= 0) {
+                            if (proxy->remaining >> 56) return false;
+                            proxy->remaining = proxy->remaining * 16 + v;
+                        } else if (ch == '\r') {
+                            proxy->chunk = ChunkState::SIZE_LF;
+                        } else if (ch == ';' || ch == ' ' || ch == '\t') {
+                            proxy->chunk = ChunkState::EXT;
+                        } else {
+                            return false;
+                        }
+                        break;
+                    }
+                    case ChunkState::EXT: {
+                        if (ch == '\r') proxy->chunk = ChunkState::SIZE_LF;
+                        break;
+                    }
+                    case ChunkState::SIZE_LF: {
+                        if (ch != '\n') return false;
+                        proxy->chunk = proxy->remaining ? ChunkState::DATA : ChunkState::TRAILER;
+                        proxy->chunkLineEmpty = true;
+                        break;
+                    }
+                    case ChunkState::DATA: {
+                        size_t take = std::min<long long>(proxy->remaining, len - i);
+                        proxy->remaining -= take;
+                        i += take;
+                        if (proxy->remaining == 0) proxy->chunk = ChunkState::DATA_CR;
+                        continue;
+                    }
+                    case ChunkState::DATA_CR: {
+                        if (ch != '\r') return false;
+                        proxy->chunk = ChunkState::DATA_LF;
+                        break;
+                    }
+                    case ChunkState::DATA_LF: {
+                        if (ch != '\n') return false;
+                        proxy->chunk = ChunkState::SIZE;
+                        break;
+                    }
+                    case ChunkState::TRAILER: {
+                        if (ch == '\r') {
+                            proxy->chunk = ChunkState::TRAILER_LF;
+                        } else {
+                            proxy->chunkLineEmpty = false;
+                        }
+                        break;
+                    }
+                    case ChunkState::TRAILER_LF: {
+                        if (ch != '\n') return false;
+                        if (proxy->chunkLineEmpty) proxy->bodyDone = true;
+                        proxy->chunk = ChunkState::TRAILER;
+                        proxy->chunkLineEmpty = true;
+                        break;
+                    }
+                }
+                ++i;
+            }
+            used = i;
+            return true;
+        }
+
+        // 把从上游读到的响应体放入发送缓冲,超出响应边界的字节说明上游连接不可复用
+        bool consume(const char *p, size_t len) {
+            size_t used = len;
+            switch (proxy->mode) {
+                case BodyMode::NONE: {
+                    used = 0;
+                    break;
+                }
+                case BodyMode::LENGTH: {
+                    used = std::min<long long>(proxy->remaining, len);
+                    proxy->remaining -= used;
+                    proxy->bodyDone = proxy->remaining == 0;
+                    break;
+                }
+                case BodyMode::CHUNKED: {
+                    if (!parseChunk(p, len, used)) return false;
+                    break;
+                }
+                case BodyMode::EOF_CLOSE: {
+                    break;
+                }
+            }
+            if (used < len) proxy->reusable = false;
+            proxy->out.append(p, used);
+            return true;
+        }
+
+        HttpCode readHead() {
+            char buf[4096];
+            while (true) {
+                auto cnt = recv(proxy->ufd, buf, sizeof(buf), 0);
+                if (cnt == -1) {
+                    if (errno == EAGAIN) return armUpstream(EPOLLIN);
+                    if (errno == EINTR) continue;
+                    return fail(HttpCode::BAD_GATEWAY);
+                } else if (cnt == 0) {
+                    return fail(HttpCode::BAD_GATEWAY);
+                }
+                proxy->received = true;
+                size_t from = proxy->head.size() > 3 ? proxy->head.size() - 3 : 0;
+                proxy->head.append(buf, cnt);
+                size_t end = proxy->head.find("\r\n\r\n", from);
+                if (end != string::npos) {
+                    string rest = proxy->head.substr(end + 4);
+                    proxy->head.resize(end + 4);
+                    if (!parseHead()) return fail(HttpCode::BAD_GATEWAY);
+                    HSHR_TRACE(upstream_head, INSTANT, client->traceId, proxy->status);
+                    if (!consume(rest.data(), rest.size())) return fail(HttpCode::BAD_GATEWAY);
+                    return relay();
+                }
+                if (proxy->head.size() > proxydata::MAX_HEAD_SIZE) {
+                    return fail(HttpCode::BAD_GATEWAY);
+                }
+            }
+        }
+
+        bool usePipe() {
+            if (proxy->mode != BodyMode::LENGTH || proxy->remaining < SPLICE_MIN) return false;
+            return proxy->pipefd[0] >= 0 || pipe2(proxy->pipefd, O_NONBLOCK | O_CLOEXEC) == 0;
+        }
+
+        // 与writeBuf相同,每次调度最多转发一个配额
+        HttpCode relay() {
+            size_t sent = 0;
+            auto start = std::chrono::steady_clock::now();
+            while (true) {
+                if (sent >= httpdata::sendQuantum
+                    || std::chrono::steady_clock::now() - start >= httpdata::sendTimeQuantum) {
+                    return armClient(true);
+                }
+                if (proxy->outSent < proxy->out.size()) {
+                    auto cnt = send(client->fd, proxy->out.data() + proxy->outSent,
+                                    proxy->out.size() - proxy->outSent, MSG_NOSIGNAL);
+                    if (cnt == -1) {
+                        if (errno == EAGAIN) return armClient(bulk());
+                        if (errno == EINTR) continue;
+                        return fail(HttpCode::BAD_GATEWAY);
+                    }
+                    proxy->outSent += cnt;
+                    sent += cnt;
+                    if (proxy->outSent == proxy->out.size()) {
+                        proxy->out.clear();
+                        proxy->outSent = 0;
+                    }
+                    continue;
+                }
+                if (proxy->pipeLen > 0) {
+                    auto cnt = splice(proxy->pipefd[0], NULL, client->fd, NULL, proxy->pipeLen,
+                                      SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                    if (cnt == -1) {
+                        if (errno == EAGAIN) return armClient(bulk());
+                        if (errno == EINTR) continue;
+                        return fail(HttpCode::BAD_GATEWAY);
+                    }
+                    proxy->pipeLen -= cnt;
+                    sent += cnt;
+                    continue;
+                }
+                if (proxy->bodyDone) return complete();
+                if (usePipe()) {
+                    size_t want = std::min<long long>(proxy->remaining, PIPE_SIZE);
+                    auto cnt = splice(proxy->ufd, NULL, proxy->pipefd[1], NULL, want,
+                                      SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                    if (cnt == -1) {
+                        if (errno == EAGAIN) return armUpstream(EPOLLIN);
+                        if (errno == EINTR) continue;
+                        return fail(HttpCode::BAD_GATEWAY);
+                    } else if (cnt == 0) {
+                        return fail(HttpCode::BAD_GATEWAY);
+                    }
+                    proxy->pipeLen += cnt;
+                    proxy->remaining -= cnt;
+                    proxy->bodyDone = proxy->remaining == 0;
+                } else {
+                    char buf[16384];
+                    auto cnt = recv(proxy->ufd, buf, sizeof(buf), 0);
+                    if (cnt == -1) {
+                        if (errno == EAGAIN) return armUpstream(EPOLLIN);
+                        if (errno == EINTR) continue;
+                        return fail(HttpCode::BAD_GATEWAY);
+                    } else if (cnt == 0) {
+                        if (proxy->mode != BodyMode::EOF_CLOSE) return fail(HttpCode::BAD_GATEWAY);
+                        proxy->bodyDone = true;
+                        continue;
+                    }
+                    if (!consume(buf, cnt)) return fail(HttpCode::BAD_GATEWAY);
+                }
+            }
+        }
+
+        // 响应转发完毕,上游连接放回池中,客户端连接按长短连接处理
+        HttpCode complete() {
+            auto op = client->op;
+            HSHR_TRACE(upstream_done, INSTANT, client->traceId, proxy->reusable);
+            if (proxy->reusable) {
+                op->detachConnfd(proxy->ufd);
+                op->getUpstreams().release(proxy->index, proxy->ufd);
+            } else {
+                dropUpstream();
+            }
+            data->proxy.reset();
+            if (data->linger && !op->isDraining()) {
+                data->init();
+                op->modConnfd(client->fd, EPOLLIN);
+            } else {
+                op->delConnfd(client->fd);
+            }
+            return HttpCode::NO_REQUEST;
+        }
+
+      public:
+        proxyprocess(conn<httpdata> const *client)
+            : client(client), data(client->data.get()), proxy(data->proxy.get()) {}
+        ~proxyprocess() = default;
+        proxyprocess(const proxyprocess &) = delete;
+        proxyprocess &operator=(const proxyprocess &) = delete;
+
+        HttpCode start(int index) {
+            data->proxy = std::make_unique<proxydata>(index);
+            proxy = data->proxy.get();
+            buildRequest();
+            if (proxy->bodyRemaining > 0 && data->expectContinue) {
+                // Expect不转发给上游,由代理直接答复,客户端收到后发送请求体
+                const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+                send(client->fd, cont, strlen(cont), MSG_NOSIGNAL | MSG_DONTWAIT);
+            }
+            return connectUpstream();
+        }
+
+        // 上游连接就绪,依次完成连接,发送请求,读取响应头,转发响应体
+        HttpCode onUpstream(decltype(epoll_event::events) statu) {
+            if (!proxy->requestDone()) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(proxy->ufd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0 || (statu & (EPOLLERR | EPOLLHUP))) return fail(HttpCode::BAD_GATEWAY);
+                return forward();
+            }
+            if (!proxy->headDone) return readHead();
+            return relay();
+        }
+
+        // 客户端连接可读时继续转发请求体,可写时继续转发响应
+        HttpCode onClient() { return proxy->requestDone() ? relay() : forward(); }
+    };
+
+}  // namespace sinksky
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <string.h>
@@ -8,14 +9,24 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <vector>
 
+#include "hotrestart.hpp"
+#include "listener.hpp"
+#include "ratelimit.hpp"
 #include "timer.hpp"
+#include "trace.hpp"
+#include "upstream.hpp"
 
 namespace sinksky {
     using std::function;
     using std::unique_ptr;
+    using std::vector;
 
     using timerNodev = timerNode<function<void()>>;
     using timerHeapv = timerHeap<function<void()>>;
@@ -26,27 +37,56 @@ namespace sinksky {
     template <typename Datatype>
     struct conn {
         int fd;
+        uint64_t traceId;
+        bool bulk;  // 下次就绪时以大流量类别排队
+        int upstream;  // 上游编号,客户端连接为-1
+        int timeout;
+        conn *peer;  // 反向代理时客户端与上游连接互相指向,同一时刻只有一方注册在epoll中
+        std::atomic<bool> armed;  // 已注册在epoll中等待事件,未交给工作线程
+        rateLimiter::bucket *limit;  // 来源IP的限制表项,不受限制时为nullptr
         decltype(epoll_event::events) statu;
         timerNodev *timer;
         eventloop<Datatype> *op;
         unique_ptr<Datatype> data;
     };
 
+    template <typename Datatype>
+    uint64_t traceKey(conn<Datatype> *const &c) {
+        return c->traceId;
+    }
+
     // 连接,监听,定时,统一事件源
     template <typename Datatype>
     class eventloop {
       public:
         static const int MAX_EVENT_NUM = 4096;
         static const int TIMESLOT = 5;
+        static const int DRAIN_TIMEOUT = 6 * TIMESLOT;
 
       private:
         static const int MAX_CONN_FD = 100000;
         int epfd;
-        int listenfd;
+        vector<int> listenfds;
+        vector<listenOption> listenOpts;
         static int pipefd[2];
         bool isTimeout;
+        uint64_t connSerial;
         unique_ptr<epoll_event[]> events;
+        // 定时器与反向代理的配对也会在工作线程中修改(建立上游连接,关闭连接,放回连接池)
+        // 超时回调在持锁时关闭连接,所以使用可重入锁
+        std::recursive_mutex timerMtx;
         timerHeapv timerManage;
+        upstreamPool upstreams;
+        rateLimiter limiter;
+        string ctlPath;  // 热重启控制套接字路径,为空表示不支持热重启
+        int ctlfd;
+        int handoverfd;  // 正在向新进程交接的控制连接
+        handoff inherited;
+        function<string()> manifest;
+        std::atomic<int> clientNum;
+        std::atomic<bool> draining;
+        bool kickPending;  // 交接刚完成,本轮事件分发后唤醒所有客户端连接
+        std::chrono::steady_clock::time_point drainDeadline;
         unique_ptr<conn<Datatype>> fd2conn[MAX_CONN_FD];
 
       private:
@@ -92,6 +132,7 @@ namespace sinksky {
         }
 
         void timerHandle() {
+            std::lock_guard<std::recursive_mutex> locker(timerMtx);
             timerManage.tick();
             alarm(TIMESLOT);
         }
@@ -102,34 +143,156 @@ namespace sinksky {
             addfd(pipefd[0]);
             addSig(SIGALRM);
             addSig(SIGTERM);
+            signal(SIGPIPE, SIG_IGN);
         }
 
-        void initListen(const char *ip, int port) {
-            sockaddr_in address;
-            bzero(&address, sizeof(address));
-            address.sin_family = AF_INET;
-            inet_pton(AF_INET, ip, &address.sin_addr);
-            address.sin_port = htons(port);
+        // 优先使用从旧进程继承的监听套接字,没有用到的继承套接字直接关闭
+        int adoptListen(const listenOption &opt) {
+            for (auto it = inherited.fds.begin(); it != inherited.fds.end(); ++it) {
+                if (sameAddress(*it, opt)) {
+                    int fd = *it;
+                    inherited.fds.erase(it);
+                    return fd;
+                }
+            }
+            return openListen(opt);
+        }
 
-            listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
-            int optval = 1;
-            setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+        bool initListen(const vector<listenOption> &listens) {
+            for (auto &opt : listens) {
+                int fd = adoptListen(opt);
+                if (fd < 0) {
+                    if (opt.family == Family::UNIX) {
+                        fprintf(stderr, "listen unix:%s: %s\n", opt.address.c_str(), strerror(errno));
+                    } else {
+                        fprintf(stderr, "listen %s port %d: %s\n", opt.address.c_str(), opt.port,
+                                strerror(errno));
+                    }
+                    continue;
+                }
+                addfd(fd);
+                listenfds.push_back(fd);
+                listenOpts.push_back(opt);
+            }
+            for (int fd : inherited.fds) close(fd);
+            inherited.fds.clear();
+            if (listenfds.empty()) {
+                fprintf(stderr, "no listening socket could be opened\n");
+                return false;
+            }
+            return true;
+        }
 
-            bind(listenfd, (sockaddr *)&address, sizeof(address));
-            listen(listenfd, MAX_EVENT_NUM);
+        // 监听控制套接字,并通知旧进程停止accept
+        void initControl() {
+            if (ctlPath.empty()) return;
+            ctlfd = openControl(ctlPath.c_str());
+            if (ctlfd < 0) {
+                perror(ctlPath.c_str());
+            } else {
+                addfd(ctlfd);
+            }
+            if (inherited.sock >= 0) {
+                send(inherited.sock, &handoffReady, 1, MSG_NOSIGNAL);
+                close(inherited.sock);
+                inherited.sock = -1;
+            }
+        }
 
-            addfd(listenfd);
+        // 新进程连接控制套接字,交出监听套接字后等待其就绪通知
+        void handleControl() {
+            int sock;
+            while ((sock = accept(ctlfd, NULL, NULL)) >= 0) {
+                if (!sameUser(sock)) {
+                    fprintf(stderr, "%s: rejected control connection from another user\n",
+                            ctlPath.c_str());
+                    close(sock);
+                    continue;
+                }
+                if (handoverfd >= 0 || draining) {
+                    close(sock);
+                    continue;
+                }
+                string hot = manifest ? manifest() : string();
+                if (!handover(sock, listenfds, hot)) {
+                    perror("handover");
+                    close(sock);
+                    continue;
+                }
+                handoverfd = sock;
+                addfd(handoverfd);
+            }
+        }
+
+        // 新进程就绪后关闭监听套接字,处理完已有连接后退出
+        // 新进程失败退出时连接被关闭,继续正常服务
+        void handleHandover() {
+            char msg;
+            auto cnt = recv(handoverfd, &msg, 1, 0);
+            if (cnt < 0 && errno == EAGAIN) return;
+            removefd(handoverfd);
+            handoverfd = -1;
+            if (cnt != 1 || msg != handoffReady) {
+                fprintf(stderr, "new process exited before taking over\n");
+                return;
+            }
+            for (int fd : listenfds) removefd(fd);
+            // 套接字文件已属于新进程,退出时不能删除
+            listenfds.clear();
+            listenOpts.clear();
+            removefd(ctlfd);
+            ctlfd = -1;
+            drainDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(DRAIN_TIMEOUT);
+            draining = true;
+            kickPending = true;
+            fprintf(stderr, "handed over to new process, draining %d connections\n",
+                    clientNum.load());
+        }
+
+        // 交接后把每个等待中的客户端连接以可写事件唤醒一次,空闲的HTTP/1长连接随即关闭,HTTP/2连接发送GOAWAY
+        // 必须在本轮事件分发完之后调用,否则已取出但未分发的事件会使连接被处理两次
+        // 正在工作线程中的连接不重复唤醒,它们重新注册前会检查draining
+        // 工作线程释放fd2conn中的连接时都持有timerMtx,遍历期间持锁保证读到的连接不会被释放
+        void kickClients() {
+            std::lock_guard<std::recursive_mutex> locker(timerMtx);
+            for (int fd = 0; fd < MAX_CONN_FD; ++fd) {
+                conn<Datatype> *c = fd2conn[fd].get();
+                if (c == nullptr || c->upstream >= 0) continue;
+                bool expected = true;
+                if (c->armed.compare_exchange_strong(expected, false)) modfd(fd, EPOLLIN | EPOLLOUT);
+            }
+        }
+
+        bool isListenfd(int fd) {
+            for (int lfd : listenfds) {
+                if (lfd == fd) return true;
+            }
+            return false;
         }
 
       public:
         eventloop()
             : epfd(epoll_create(MAX_EVENT_NUM)),
               isTimeout(false),
-              events(std::make_unique<epoll_event[]>(MAX_EVENT_NUM)) {}
+              connSerial(0),
+              events(std::make_unique<epoll_event[]>(MAX_EVENT_NUM)),
+              ctlfd(-1),
+              handoverfd(-1),
+              clientNum(0),
+              draining(false),
+              kickPending(false) {}
 
         ~eventloop() {
             close(epfd);
-            close(listenfd);
+            if (ctlfd >= 0) {
+                close(ctlfd);
+                unlink(ctlPath.c_str());
+            }
+            if (handoverfd >= 0) close(handoverfd);
+            for (size_t i = 0; i < listenfds.size(); ++i) {
+                close(listenfds[i]);
+                if (listenOpts[i].family == Family::UNIX) unlink(listenOpts[i].address.c_str());
+            }
             close(pipefd[0]);
             close(pipefd[1]);
         }
@@ -138,28 +301,133 @@ namespace sinksky {
 
         eventloop &operator=(const eventloop &) = delete;
 
+        upstreamPool &getUpstreams() { return upstreams; }
+
+        void setUpstreams(const vector<upstreamOption> &opts) { upstreams.init(opts); }
+
+        rateLimiter &getLimiter() { return limiter; }
+
+        void setLimit(const limitOption &opt) { limiter.init(opt); }
+
+        // 开启热重启: 在path上监听控制套接字,inherited为启动时从旧进程取得的状态,
+        // hot生成交给下一个进程的热点清单
+        void setRestart(const string &path, handoff &&from, function<string()> hot) {
+            ctlPath = path;
+            inherited = std::move(from);
+            manifest = std::move(hot);
+        }
+
+        // 已交出监听套接字,正在处理剩余连接
+        bool isDraining() const { return draining.load(std::memory_order_relaxed); }
+
+        // 关闭连接,反向代理中的另一方一并关闭
         void delConnfd(int fd) {
+            std::lock_guard<std::recursive_mutex> locker(timerMtx);
+            HSHR_TRACE(close, INSTANT, fd2conn[fd]->traceId, fd);
             timerManage.delTimer(fd2conn[fd]->timer);
+            if (fd2conn[fd]->upstream >= 0) {
+                upstreams.closed(fd2conn[fd]->upstream);
+            } else {
+                --clientNum;
+            }
+            limiter.release(fd2conn[fd]->limit);
+            conn<Datatype> *peer = fd2conn[fd]->peer;
             fd2conn[fd].reset();
             removefd(fd);
+            if (peer != nullptr) {
+                peer->peer = nullptr;
+                delConnfd(peer->fd);
+            }
+        }
+
+        // 解除反向代理的配对,之后关闭任一方不影响另一方
+        void unlinkPeer(int fd) {
+            std::lock_guard<std::recursive_mutex> locker(timerMtx);
+            conn<Datatype> *peer = fd2conn[fd]->peer;
+            if (peer != nullptr) {
+                peer->peer = nullptr;
+                fd2conn[fd]->peer = nullptr;
+            }
+        }
+
+        // 从事件循环中移除但不关闭,用于把上游长连接放回连接池
+        void detachConnfd(int fd) {
+            std::lock_guard<std::recursive_mutex> locker(timerMtx);
+            timerManage.delTimer(fd2conn[fd]->timer);
+            unlinkPeer(fd);
+            fd2conn[fd].reset();
+            epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
         }
 
-        void addConnfd(int fd) {
+        void addConnfd(int fd, rateLimiter::bucket *limit = nullptr) {
             addfd(fd, true);
             fd2conn[fd] = std::make_unique<conn<Datatype>>();
             fd2conn[fd]->fd = fd;
+            fd2conn[fd]->traceId = ++connSerial;
+            fd2conn[fd]->bulk = false;
+            fd2conn[fd]->upstream = -1;
+            fd2conn[fd]->timeout = 3 * TIMESLOT;
+            fd2conn[fd]->peer = nullptr;
+            fd2conn[fd]->armed = true;
+            fd2conn[fd]->limit = limit;
             fd2conn[fd]->op = this;
             fd2conn[fd]->data = std::make_unique<Datatype>();
-            timerNodev *ptr
-                = timerManage.addTimer(3 * TIMESLOT, [this, fd]() -> void { delConnfd(fd); });
+            ++clientNum;
+            HSHR_TRACE(accept, INSTANT, fd2conn[fd]->traceId, fd);
+            std::lock_guard<std::recursive_mutex> locker(timerMtx);
+            timerNodev *ptr = timerManage.addTimer(3 * TIMESLOT, [this, fd]() -> void {
+                HSHR_TRACE(timer_expire, INSTANT, fd2conn[fd]->traceId, fd);
+                delConnfd(fd);
+            });
             fd2conn[fd]->timer = ptr;
         }
 
-        void modConnfd(int fd, int ev) { modfd(fd, ev); }
+        // 由工作线程调用,注册到上游的连接并与客户端连接配对
+        // 注册后事件可能立即在其他线程中处理,所以必须是工作线程对这对连接的最后一个操作
+        void addUpstreamfd(int fd, int index, int clientfd, int ev) {
+            auto c = std::make_unique<conn<Datatype>>();
+            c->fd = fd;
+            c->traceId = fd2conn[clientfd]->traceId;
+            c->bulk = false;
+            c->upstream = index;
+            c->timeout = upstreams.option(index).timeout;
+            c->armed = true;
+            c->limit = nullptr;
+            c->op = this;
+            {
+                std::lock_guard<std::recursive_mutex> locker(timerMtx);
+                c->peer = fd2conn[clientfd].get();
+                fd2conn[clientfd]->peer = c.get();
+                c->timer = timerManage.addTimer(c->timeout, [this, fd]() -> void {
+                    HSHR_TRACE(timer_expire, INSTANT, fd2conn[fd]->traceId, fd);
+                    delConnfd(fd);
+                });
+                fd2conn[fd] = std::move(c);
+            }
+            epoll_event event;
+            event.data.fd = fd;
+            event.events = ev | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+        }
+
+        void modConnfd(int fd, int ev, bool bulk = false) {
+            fd2conn[fd]->bulk = bulk;
+            // 先标记再注册,注册后事件可能立即在主线程中分发
+            fd2conn[fd]->armed = true;
+            modfd(fd, ev);
+        }
 
         template <typename Threadpooltype>
-        void loop(const char *ip, int port, Threadpooltype *pool) {
-            initListen(ip, port);
+        bool loop(const char *ip, int port, Threadpooltype *pool) {
+            return loop(vector<listenOption>{inetListen(ip, port)}, pool);
+        }
+
+        // 同时监听多个套接字(IPv4,IPv6,Unix域),所有连接走同一条conn处理路径
+        // 没有任何监听套接字打开成功时返回false
+        template <typename Threadpooltype>
+        bool loop(const vector<listenOption> &listens, Threadpooltype *pool) {
+            if (!initListen(listens)) return false;
+            initControl();
             initPipe();
             alarm(TIMESLOT);
             bool runLoop = true;
@@ -167,12 +435,21 @@ namespace sinksky {
                 int cnt = epoll_wait(epfd, events.get(), MAX_EVENT_NUM, -1);
 
                 for (int i = 0; i < cnt; ++i) {
-                    if (events[i].data.fd == listenfd) {
+                    if (isListenfd(events[i].data.fd)) {
                         int connfd;
-                        sockaddr_in address;
-                        socklen_t len;
-                        while ((connfd = accept(listenfd, (sockaddr *)&address, &len)) > 0) {
-                            addConnfd(connfd);
+                        sockaddr_storage address;
+                        socklen_t len = sizeof(address);
+                        while ((connfd = accept(events[i].data.fd, (sockaddr *)&address, &len))
+                               > 0) {
+                            len = sizeof(address);
+                            rateLimiter::bucket *limit;
+                            if (!limiter.admit((sockaddr *)&address, limit)) {
+                                // 超过来源IP的连接数限制,直接关闭,不占用fd2conn与线程池
+                                HSHR_TRACE(limit_conn, INSTANT, 0, connfd);
+                                close(connfd);
+                                continue;
+                            }
+                            addConnfd(connfd, limit);
                         }
                     } else if (events[i].data.fd == pipefd[0]) {
                         char signals[1024];
@@ -183,7 +460,7 @@ namespace sinksky {
                             continue;
                         else {
                             for (int j = 0; j < num; j++) {
-                                switch (signals[i]) {
+                                switch (signals[j]) {
                                     case SIGALRM: {
                                         isTimeout = true;
                                         break;
@@ -194,22 +471,44 @@ namespace sinksky {
                                 }
                             }
                         }
-                    } else if (events[i].events & (EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+                    } else if (events[i].data.fd == ctlfd) {
+                        handleControl();
+                    } else if (events[i].data.fd == handoverfd) {
+                        handleHandover();
+                    } else if ((events[i].events & (EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+                               && fd2conn[events[i].data.fd]->upstream < 0) {
+                        // 上游关闭时可能还有未读完的响应,交给工作线程处理
                         delConnfd(events[i].data.fd);
                     } else {
                         int alreadyfd = events[i].data.fd;
-                        fd2conn[alreadyfd]->statu = events[i].events;
-                        auto newtimer
-                            = timerManage.updateTimer(fd2conn[alreadyfd]->timer, 3 * TIMESLOT);
-                        fd2conn[alreadyfd]->timer = newtimer;
-                        pool->add(fd2conn[alreadyfd].get());
+                        conn<Datatype> *c = fd2conn[alreadyfd].get();
+                        c->statu = events[i].events;
+                        c->armed = false;
+                        {
+                            std::lock_guard<std::recursive_mutex> locker(timerMtx);
+                            c->timer = timerManage.updateTimer(c->timer, c->timeout);
+                            if (c->peer != nullptr) {
+                                c->peer->timer
+                                    = timerManage.updateTimer(c->peer->timer, c->peer->timeout);
+                            }
+                        }
+                        pool->add(c, c->bulk);
                     }
                 }
                 if (isTimeout) {
                     timerHandle();
                     isTimeout = false;
                 }
+                if (kickPending) {
+                    kickClients();
+                    kickPending = false;
+                }
+                if (draining
+                    && (clientNum == 0 || std::chrono::steady_clock::now() >= drainDeadline)) {
+                    runLoop = false;
+                }
             }
+            return true;
         }
     };
 
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sinksky {
+    using std::string;
+    using std::vector;
+
+    // 访问计数,热重启时把访问最多的路径交给新进程预热
+    // 按URL哈希分片加锁,分片满后只累加已有路径,先出现的热点路径不会被挤出
+    class hotPaths {
+      public:
+        static const size_t MANIFEST_NUM = 1024;
+
+      private:
+        static const int SHARD_NUM = 16;
+        static const size_t SHARD_LIMIT = 4096;
+
+        struct shard {
+            std::mutex mtx;
+            std::unordered_map<string, uint64_t> counts;
+        };
+        shard shards[SHARD_NUM];
+
+      public:
+        hotPaths() = default;
+        ~hotPaths() = default;
+        hotPaths(const hotPaths &) = delete;
+        hotPaths &operator=(const hotPaths &) = delete;
+
+        void hit(const string &url, uint64_t n = 1) {
+            shard &s = shards[std::hash<string>()(url) % SHARD_NUM];
+            std::lock_guard<std::mutex> locker(s.mtx);
+            auto it = s.counts.find(url);
+            if (it != s.counts.end()) {
+                it->second += n;
+            } else if (s.counts.size() < SHARD_LIMIT) {
+                s.counts.emplace(url, n);
+            }
+        }
+
+        // 清单每行为 "访问次数 路径",按访问次数从多到少排列
+        string manifest() {
+            vector<std::pair<uint64_t, string>> all;
+            for (auto &s : shards) {
+                std::lock_guard<std::mutex> locker(s.mtx);
+                for (auto &kv : s.counts) all.emplace_back(kv.second, kv.first);
+            }
+            size_t num = std::min(all.size(), MANIFEST_NUM);
+            std::partial_sort(all.begin(), all.begin() + num, all.end(),
+                              [](const std::pair<uint64_t, string> &a,
+                                 const std::pair<uint64_t, string> &b) { return a.first > b.first; });
+            string out;
+            char count[32];
+            for (size_t i = 0; i < num; ++i) {
+                snprintf(count, sizeof(count), "%llu ", (unsigned long long)all[i].first);
+                out += count;
+                out += all[i].second;
+                out += '\n';
+            }
+            return out;
+        }
+
+        template <typename Functype>
+        static void forEach(const string &manifest, Functype &&func) {
+            size_t pos = 0;
+            while (pos < manifest.size()) {
+                size_t end = manifest.find('\n', pos);
+                if (end == string::npos) end = manifest.size();
+                size_t space = manifest.find(' ', pos);
+                if (space < end) {
+                    uint64_t count = strtoull(manifest.c_str() + pos, nullptr, 10);
+                    func(manifest.substr(space + 1, end - space - 1), count);
+                }
+                pos = end + 1;
+            }
+        }
+    };
+
+    // 热重启时旧进程交给新进程的状态
+    struct handoff {
+        int sock = -1;  // 与旧进程的控制连接,新进程开始accept前在此发送就绪通知
+        vector<int> fds;  // 旧进程的监听套接字
+        string manifest;  // 热点路径清单
+    };
+
+    struct handoffHeader {
+        char magic[4];
+        uint32_t fdNum;
+        uint32_t manifestLen;
+    };
+
+    static const char handoffMagic[4] = {'H', 'S', 'H', 'R'};
+    static const char handoffReady = 'R';
+    static const int MAX_HANDOFF_FD = 64;
+
+    inline bool fillUnixAddress(const char *path, sockaddr_un &address) {
+        bzero(&address, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(address.sun_path)) return false;
+        strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+        return true;
+    }
+
+    // 旧进程的控制套接字,只允许同一用户连接
+    inline int openControl(const char *path) {
+        sockaddr_un address;
+        if (!fillUnixAddress(path, address)) return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) return -1;
+        // 上一个进程的套接字文件此时已无人监听或即将退出
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+        // 套接字文件在bind时以umask创建,先收紧umask,不留其他用户可连接的窗口
+        mode_t mask = umask(077);
+        int ret = bind(fd, (sockaddr *)&address, sizeof(address));
+        umask(mask);
+        if (ret < 0 || listen(fd, 4) < 0) {
+            close(fd);
+            return -1;
+        }
+        chmod(path, 0600);
+        return fd;
+    }
+
+    // 控制连接的对端必须与本进程是同一用户
+    inline bool sameUser(int sock) {
+        ucred cred;
+        socklen_t len = sizeof(cred);
+        return getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == geteuid();
+    }
+
+    // 旧进程在主线程中调用,发送监听套接字与热点清单
+    inline bool handover(int sock, const vector<int> &fds, const string &manifest) {
+        if (fds.empty() || fds.size() > MAX_HANDOFF_FD) return false;
+        timeval tv{1, 0};
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        handoffHeader header;
+        memcpy(header.magic, handoffMagic, sizeof(header.magic));
+        header.fdNum = fds.size();
+        header.manifestLen = manifest.size();
+        iovec iov{&header, sizeof(header)};
+        char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FD)];
+        bzero(control, sizeof(control));
+        msghdr msg;
+        bzero(&msg, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+        if (sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(header)) return false;
+
+        size_t done = 0;
+        while (done < manifest.size()) {
+            auto cnt = send(sock, manifest.data() + done, manifest.size() - done, MSG_NOSIGNAL);
+            if (cnt <= 0) {
+                if (cnt < 0 && errno == EINTR) continue;
+                return false;
+            }
+            done += cnt;
+        }
+        return true;
+    }
+
+    // 新进程启动时调用,没有旧进程在监听控制套接字时返回false,按冷启动处理
+    inline bool takeover(const char *path, handoff &h) {
+        sockaddr_un address;
+        if (!fillUnixAddress(path, address)) return false;
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock < 0) return false;
+        if (connect(sock, (sockaddr *)&address, sizeof(address)) < 0) {
+            close(sock);
+            return false;
+        }
+        timeval tv{5, 0};
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        handoffHeader header;
+        iovec iov{&header, sizeof(header)};
+        char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FD)];
+        msghdr msg;
+        bzero(&msg, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        auto cnt = recvmsg(sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cnt > 0 && cmsg != nullptr;
+             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                size_t num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                h.fds.resize(num);
+                memcpy(h.fds.data(), CMSG_DATA(cmsg), sizeof(int) * num);
+            }
+        }
+        bool ok = cnt == sizeof(header) && !(msg.msg_flags & MSG_CTRUNC)
+                  && !memcmp(header.magic, handoffMagic, sizeof(header.magic))
+                  && header.fdNum == h.fds.size();
+        if (ok) {
+            h.manifest.resize(header.manifestLen);
+            size_t done = 0;
+            while (done < h.manifest.size()) {
+                cnt = recv(sock, &h.manifest[done], h.manifest.size() - done, 0);
+                if (cnt <= 0) {
+                    if (cnt < 0 && errno == EINTR) continue;
+                    break;
+                }
+                done += cnt;
+            }
+            ok = done == h.manifest.size();
+        }
+        if (!ok) {
+            fprintf(stderr, "%s: bad handoff from old process, starting cold\n", path);
+            for (int fd : h.fds) close(fd);
+            h.fds.clear();
+            h.manifest.clear();
+            close(sock);
+            return false;
+        }
+        h.sock = sock;
+        return true;
+    }
+
+}  // namespace sinksky
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace sinksky {
+    using std::string;
+
+    enum class Family { INET, INET6, UNIX };
+
+    // 监听套接字配置
+    // 每个监听套接字有独立的地址族,backlog与套接字选项
+    struct listenOption {
+        Family family = Family::INET;
+        string address;  // IP地址或Unix域套接字路径
+        int port = 0;
+        int backlog = 4096;
+        bool reuseAddr = true;
+        bool reusePort = false;
+        bool noDelay = false;
+        bool v6Only = false;
+        int deferAccept = 0;  // TCP_DEFER_ACCEPT 秒数
+        int rcvBuf = 0;
+        int sndBuf = 0;
+        int mode = -1;  // Unix域套接字文件权限
+    };
+
+    // 端口必须完整解析且在1-65535之间
+    inline bool parsePort(const char *str, int &port) {
+        char *end;
+        errno = 0;
+        long val = strtol(str, &end, 10);
+        if (end == str || *end != '\0' || errno != 0 || val < 1 || val > 65535) return false;
+        port = val;
+        return true;
+    }
+
+    inline listenOption inetListen(const char *ip, int port) {
+        listenOption opt;
+        opt.family = Family::INET;
+        opt.address = ip;
+        opt.port = port;
+        return opt;
+    }
+
+    // 解析形如 tcp:0.0.0.0:80 tcp6:[::]:80 unix:/run/hshr.sock 的监听描述
+    // 逗号后可附加选项: backlog=N reuseport nodelay v6only defer=N rcvbuf=N sndbuf=N mode=0660
+    inline bool parseListen(const char *spec, listenOption &opt) {
+        string str(spec);
+        string addr = str.substr(0, str.find(','));
+        string opts = addr.size() < str.size() ? str.substr(addr.size() + 1) : "";
+
+        if (!addr.compare(0, sizeof("tcp6:") - 1, "tcp6:")) {
+            opt.family = Family::INET6;
+            addr = addr.substr(sizeof("tcp6:") - 1);
+            auto close = addr.rfind(']');
+            if (addr.empty() || addr[0] != '[' || close == string::npos
+                || close + 1 >= addr.size() || addr[close + 1] != ':')
+                return false;
+            opt.address = addr.substr(1, close - 1);
+            if (!parsePort(addr.c_str() + close + 2, opt.port)) return false;
+        } else if (!addr.compare(0, sizeof("tcp:") - 1, "tcp:")) {
+            opt.family = Family::INET;
+            addr = addr.substr(sizeof("tcp:") - 1);
+            auto colon = addr.rfind(':');
+            if (colon == string::npos) return false;
+            opt.address = addr.substr(0, colon);
+            if (!parsePort(addr.c_str() + colon + 1, opt.port)) return false;
+        } else if (!addr.compare(0, sizeof("unix:") - 1, "unix:")) {
+            opt.family = Family::UNIX;
+            opt.address = addr.substr(sizeof("unix:") - 1);
+            opt.reuseAddr = false;
+            if (opt.address.empty() || opt.address.size() >= sizeof(sockaddr_un::sun_path))
+                return false;
+        } else {
+            return false;
+        }
+
+        while (!opts.empty()) {
+            string item = opts.substr(0, opts.find(','));
+            opts = item.size() < opts.size() ? opts.substr(item.size() + 1) : "";
+            string key = item.substr(0, item.find('='));
+            const char *val = key.size() < item.size() ? item.c_str() + key.size() + 1 : "";
+            if (key == "backlog") {
+                opt.backlog = atoi(val);
+            } else if (key == "reuseport") {
+                opt.reusePort = true;
+            } else if (key == "noreuseaddr") {
+                opt.reuseAddr = false;
+            } else if (key == "nodelay") {
+                opt.noDelay = true;
+            } else if (key == "v6only") {
+                opt.v6Only = true;
+            } else if (key == "defer") {
+                opt.deferAccept = atoi(val);
+            } else if (key == "rcvbuf") {
+                opt.rcvBuf = atoi(val);
+            } else if (key == "sndbuf") {
+                opt.sndBuf = atoi(val);
+            } else if (key == "mode") {
+                opt.mode = strtol(val, nullptr, 8);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 根据配置填充套接字地址,返回地址族,失败返回-1
+    inline int makeAddress(const listenOption &opt, sockaddr_storage &address, socklen_t &len) {
+        bzero(&address, sizeof(address));
+        switch (opt.family) {
+            case Family::INET: {
+                auto addr = (sockaddr_in *)&address;
+                addr->sin_family = AF_INET;
+                addr->sin_port = htons(opt.port);
+                if (inet_pton(AF_INET, opt.address.c_str(), &addr->sin_addr) != 1) return -1;
+                len = sizeof(sockaddr_in);
+                return AF_INET;
+            }
+            case Family::INET6: {
+                auto addr = (sockaddr_in6 *)&address;
+                addr->sin6_family = AF_INET6;
+                addr->sin6_port = htons(opt.port);
+                if (inet_pton(AF_INET6, opt.address.c_str(), &addr->sin6_addr) != 1) return -1;
+                len = sizeof(sockaddr_in6);
+                return AF_INET6;
+            }
+            default: {
+                auto addr = (sockaddr_un *)&address;
+                addr->sun_family = AF_UNIX;
+                strncpy(addr->sun_path, opt.address.c_str(), sizeof(addr->sun_path) - 1);
+                len = sizeof(sockaddr_un);
+                return AF_UNIX;
+            }
+        }
+    }
+
+    // 判断已有的监听套接字(如热重启时继承的)是否绑定在配置的地址上
+    inline bool sameAddress(int fd, const listenOption &opt) {
+        sockaddr_storage want, have;
+        socklen_t wantLen, haveLen = sizeof(have);
+        if (makeAddress(opt, want, wantLen) < 0) return false;
+        bzero(&have, sizeof(have));
+        if (getsockname(fd, (sockaddr *)&have, &haveLen) < 0 || have.ss_family != want.ss_family) {
+            return false;
+        }
+        switch (want.ss_family) {
+            case AF_INET: {
+                auto a = (sockaddr_in *)&want, b = (sockaddr_in *)&have;
+                return a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr;
+            }
+            case AF_INET6: {
+                auto a = (sockaddr_in6 *)&want, b = (sockaddr_in6 *)&have;
+                return a->sin6_port == b->sin6_port
+                       && !memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(a->sin6_addr));
+            }
+            default: {
+                return !strncmp(((sockaddr_un *)&want)->sun_path, ((sockaddr_un *)&have)->sun_path,
+                                sizeof(sockaddr_un::sun_path));
+            }
+        }
+    }
+
+    // 创建并监听套接字,失败返回-1
+    inline int openListen(const listenOption &opt) {
+        sockaddr_storage address;
+        socklen_t len;
+        int domain = makeAddress(opt, address, len);
+        if (domain < 0) {
+            // inet_pton 解析失败时不设置errno
+            errno = EINVAL;
+            return -1;
+        }
+        if (opt.family == Family::UNIX) {
+            // 清理上次运行残留的套接字文件,仍有进程在监听时不能删除
+            struct stat st;
+            if (stat(opt.address.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+                int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+                bool stale = probe >= 0 && connect(probe, (sockaddr *)&address, len) < 0
+                             && errno == ECONNREFUSED;
+                if (probe >= 0) close(probe);
+                if (!stale) {
+                    errno = EADDRINUSE;
+                    return -1;
+                }
+                unlink(opt.address.c_str());
+            }
+        }
+
+        int fd = socket(domain, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) return -1;
+
+        int optval = 1;
+        if (opt.reuseAddr) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+        if (opt.reusePort) setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
+        if (opt.rcvBuf > 0) setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opt.rcvBuf, sizeof(int));
+        if (opt.sndBuf > 0) setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &opt.sndBuf, sizeof(int));
+        if (opt.family != Family::UNIX) {
+            // 监听套接字上的TCP_NODELAY会被accept出的连接继承
+            if (opt.noDelay) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+            if (opt.deferAccept > 0)
+                setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &opt.deferAccept, sizeof(int));
+        }
+        if (opt.family == Family::INET6) {
+            int v6only = opt.v6Only ? 1 : 0;
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+        }
+
+        if (bind(fd, (sockaddr *)&address, len) < 0 || listen(fd, opt.backlog) < 0) {
+            close(fd);
+            return -1;
+        }
+        if (opt.family == Family::UNIX && opt.mode >= 0) {
+            chmod(opt.address.c_str(), opt.mode);
+        }
+        return fd;
+    }
+
+}  // namespace sinksky
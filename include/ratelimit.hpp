@@ -0,0 +1,203 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace sinksky {
+    using std::string;
+    using std::unique_ptr;
+
+    // 按来源IP的限制配置,0表示不限制
+    struct limitOption {
+        int maxConn = 0;     // 每个IP同时打开的连接数
+        int rate = 0;        // 每个IP每秒请求数
+        int burst = 0;       // 令牌桶容量,默认等于rate
+        int idle = 60;       // 没有连接的表项空闲多少秒后可被回收
+    };
+
+    // 解析形如 conn=64,rate=200,burst=400,idle=60 的限制描述
+    inline bool parseLimit(const char *spec, limitOption &opt) {
+        string opts(spec);
+        while (!opts.empty()) {
+            string item = opts.substr(0, opts.find(','));
+            opts = item.size() < opts.size() ? opts.substr(item.size() + 1) : "";
+            string key = item.substr(0, item.find('='));
+            if (key.size() == item.size()) return false;
+            int val = atoi(item.c_str() + key.size() + 1);
+            if (val < 0) return false;
+            if (key == "conn") {
+                opt.maxConn = val;
+            } else if (key == "rate") {
+                opt.rate = val;
+            } else if (key == "burst") {
+                opt.burst = val;
+            } else if (key == "idle") {
+                opt.idle = val;
+            } else {
+                return false;
+            }
+        }
+        if (opt.burst == 0) opt.burst = opt.rate;
+        if (opt.burst > (1 << 20)) return false;
+        return opt.maxConn > 0 || opt.rate > 0;
+    }
+
+    // 按来源IP的连接数限制与请求速率限制
+    // 表项只由主线程在accept时插入或回收,工作线程只通过conn中保存的指针修改令牌桶与连接数,
+    // 因此令牌桶用单个64位原子变量CAS更新即可,不需要加锁
+    // 表分为多个分片,每个分片内线性探测,探测时顺便回收空闲表项,不需要额外的清理过程
+    class rateLimiter {
+      public:
+        // 令牌以1/TOKEN_SCALE为单位计数
+        static const uint64_t TOKEN_SCALE = 1024;
+
+        struct bucket {
+            uint64_t key;
+            std::atomic<uint64_t> state;  // 高32位令牌数,低32位上次补充的毫秒时间
+            std::atomic<int> conns;
+            std::atomic<uint32_t> seen;  // 最近一次访问的秒数
+        };
+
+      private:
+        static const int SHARD_NUM = 64;
+        static const int SHARD_SIZE = 1024;
+        static const int PROBE_NUM = 8;
+
+        limitOption opt;
+        std::chrono::steady_clock::time_point epoch;
+        unique_ptr<bucket[]> table;
+
+        uint32_t nowMs() {
+            auto now = std::chrono::steady_clock::now() - epoch;
+            return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+        }
+
+        uint32_t nowSec() {
+            auto now = std::chrono::steady_clock::now() - epoch;
+            return (uint32_t)std::chrono::duration_cast<std::chrono::seconds>(now).count();
+        }
+
+        // IPv4与IPv4映射地址按完整地址计,IPv6按/64前缀计,其他地址族不限制
+        static uint64_t makeKey(const sockaddr *address) {
+            if (address->sa_family == AF_INET) {
+                return 0xffffffff00000000ULL | ntohl(((const sockaddr_in *)address)->sin_addr.s_addr);
+            } else if (address->sa_family == AF_INET6) {
+                const uint8_t *p = ((const sockaddr_in6 *)address)->sin6_addr.s6_addr;
+                if (IN6_IS_ADDR_V4MAPPED(((const sockaddr_in6 *)address)->sin6_addr.s6_addr32)) {
+                    uint32_t ip;
+                    memcpy(&ip, p + 12, sizeof(ip));
+                    return 0xffffffff00000000ULL | ntohl(ip);
+                }
+                uint64_t key;
+                memcpy(&key, p, sizeof(key));
+                return key == 0 ? 1 : key;
+            }
+            return 0;
+        }
+
+        static uint64_t hash(uint64_t key) {
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdULL;
+            key ^= key >> 33;
+            key *= 0xc4ceb9fe1a85ec53ULL;
+            key ^= key >> 33;
+            return key;
+        }
+
+        uint64_t full(uint32_t now) { return ((uint64_t)opt.burst * TOKEN_SCALE << 32) | now; }
+
+        bool expired(bucket *b, uint32_t now) {
+            return b->conns.load(std::memory_order_relaxed) == 0
+                   && now - b->seen.load(std::memory_order_relaxed) >= (uint32_t)opt.idle;
+        }
+
+      public:
+        rateLimiter() = default;
+        ~rateLimiter() = default;
+        rateLimiter(const rateLimiter &) = delete;
+        rateLimiter &operator=(const rateLimiter &) = delete;
+
+        void init(const limitOption &option) {
+            opt = option;
+            epoch = std::chrono::steady_clock::now();
+            table = std::make_unique<bucket[]>(SHARD_NUM * SHARD_SIZE);
+            for (int i = 0; i < SHARD_NUM * SHARD_SIZE; ++i) {
+                table[i].key = 0;
+                table[i].state = 0;
+                table[i].conns = 0;
+                table[i].seen = 0;
+            }
+        }
+
+        bool enabled() { return table != nullptr; }
+
+        // 主线程accept后调用,超过连接数限制返回false
+        // 表满时不跟踪该来源(返回true且slot为nullptr),不会因此拒绝正常客户端
+        bool admit(const sockaddr *address, bucket *&slot) {
+            slot = nullptr;
+            uint64_t key;
+            if (!enabled() || (key = makeKey(address)) == 0) return true;
+            uint64_t h = hash(key);
+            bucket *shard = &table[(h >> 58) % SHARD_NUM * SHARD_SIZE];
+            uint32_t sec = nowSec();
+            bucket *spare = nullptr;
+            for (int i = 0; i < PROBE_NUM; ++i) {
+                bucket *b = &shard[(h + i) % SHARD_SIZE];
+                if (b->key == key) {
+                    if (opt.maxConn > 0 && b->conns.load(std::memory_order_relaxed) >= opt.maxConn)
+                        return false;
+                    b->conns.fetch_add(1, std::memory_order_relaxed);
+                    b->seen.store(sec, std::memory_order_relaxed);
+                    slot = b;
+                    return true;
+                }
+                if (spare == nullptr && (b->key == 0 || expired(b, sec))) spare = b;
+                if (b->key == 0) break;
+            }
+            if (spare != nullptr) {
+                // 回收的表项没有打开的连接,不会有工作线程同时访问
+                spare->key = key;
+                spare->state.store(full(nowMs()), std::memory_order_relaxed);
+                spare->conns.store(1, std::memory_order_relaxed);
+                spare->seen.store(sec, std::memory_order_relaxed);
+                slot = spare;
+            }
+            return true;
+        }
+
+        // 连接关闭时调用
+        void release(bucket *slot) {
+            if (slot == nullptr) return;
+            slot->seen.store(nowSec(), std::memory_order_relaxed);
+            slot->conns.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        // 工作线程处理每个请求前取一个令牌,令牌不足返回false
+        bool take(bucket *slot) {
+            if (slot == nullptr || opt.rate <= 0) return true;
+            uint32_t now = nowMs();
+            uint64_t old = slot->state.load(std::memory_order_relaxed);
+            while (true) {
+                uint64_t elapsed = std::min<uint32_t>(now - (uint32_t)old, 3600 * 1000);
+                uint64_t tokens = (old >> 32) + elapsed * opt.rate * TOKEN_SCALE / 1000;
+                tokens = std::min<uint64_t>(tokens, (uint64_t)opt.burst * TOKEN_SCALE);
+                if (tokens < TOKEN_SCALE) return false;
+                uint64_t state = ((tokens - TOKEN_SCALE) << 32) | now;
+                if (slot->state.compare_exchange_weak(old, state, std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+        }
+    };
+
+}  // namespace sinksky
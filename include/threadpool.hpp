@@ -1,10 +1,18 @@
 #pragma once
 
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
 
+#include "trace.hpp"
+
 namespace sinksky {
     using std::condition_variable;
     using std::lock_guard;
@@ -12,85 +20,199 @@ namespace sinksky {
     using std::queue;
     using std::thread;
     using std::unique_lock;
+    using std::unique_ptr;
     using std::vector;
     using std::once_flag;
 
+    // 弹性线程池配置
+    // 队首任务排队超过targetLatency且所有线程都在忙时增加线程,线程空闲超过cooldown后退出
+    struct elasticOption {
+        int minThread;
+        int maxThread;
+        std::chrono::microseconds targetLatency;
+        std::chrono::milliseconds cooldown;
+    };
+
+    // 任务分为小响应与大流量两类,小响应优先
+    // 两类都有任务时每处理BULK_RATIO个小响应至少处理一个大流量任务,避免饿死
     template <typename Restype>
     class threadpool {
+      public:
+        static const int BULK_RATIO = 4;
+
       private:
-        const int MAX_THREAD_NUM;
+        using clk = std::chrono::steady_clock;
+
+        struct entry {
+            Restype res;
+            clk::time_point enqueue;
+        };
+        enum class Fetch { TASK, STOP, RETIRE };
+
         const int MAX_QUEUE_NUM;
+        const bool elastic;
+        const elasticOption opt;
         mutex mtx;
         bool isrun;
         once_flag flag;
         condition_variable notEmpty;
         condition_variable notFull;
-        queue<Restype> resQueue;
+        queue<entry> resQueue;
+        queue<entry> bulkQueue;
+        int smallStreak;
         vector<unique_ptr<thread>> threadGroup;
+        vector<thread::id> retired;  // 已退出等待回收的线程
+        int threadNum;
+        std::atomic<int> busyNum;
+        clk::time_point lastGrow;
+        std::function<void()> worker;
 
       public:
         threadpool(int threadnum, int queuenum)
-            : isrun(true),MAX_THREAD_NUM(threadnum), MAX_QUEUE_NUM(queuenum), threadGroup(MAX_THREAD_NUM) {}
+            : MAX_QUEUE_NUM(queuenum),
+              elastic(false),
+              opt{threadnum, threadnum, std::chrono::microseconds(0), std::chrono::milliseconds(0)},
+              isrun(true),
+              smallStreak(0),
+              threadNum(threadnum),
+              busyNum(0) {}
+        threadpool(const elasticOption &option, int queuenum)
+            : MAX_QUEUE_NUM(queuenum),
+              elastic(true),
+              opt(option),
+              isrun(true),
+              smallStreak(0),
+              threadNum(option.minThread),
+              busyNum(0) {}
         ~threadpool(){
             stop();
         }
         threadpool(const threadpool&) = delete;
         threadpool& operator=(const threadpool&) = delete;
 
-        bool isFull() { return resQueue.size() == MAX_QUEUE_NUM; }
+        bool isFull() { return resQueue.size() + bulkQueue.size() >= static_cast<size_t>(MAX_QUEUE_NUM); }
 
-        bool isEmpty() { return resQueue.empty(); }
+        bool isEmpty() { return resQueue.empty() && bulkQueue.empty(); }
 
         void stop(){
             std::call_once(flag,[this](){
+                vector<unique_ptr<thread>> group;
                 {
                     lock_guard<mutex> locker(mtx);
                     isrun = false;
+                    group.swap(threadGroup);
                 }
                 notEmpty.notify_all();
                 notFull.notify_all();
-                for(int i = 0; i <MAX_THREAD_NUM ;++i){
-                    threadGroup[i]->join();
+                for (auto &t : group) {
+                    t->join();
                 }
             });
         }
 
-        void add(Restype res) {
+        void add(Restype res, bool bulk = false) {
             unique_lock<mutex> locker(mtx);
             notFull.wait(locker, [this] { return !isFull() || !isrun; });
             if (!isrun)
                 return ;
-            resQueue.push(res);
+            clk::time_point now = elastic ? clk::now() : clk::time_point();
+            queue<entry> &q = bulk ? bulkQueue : resQueue;
+            q.push({res, now});
+            HSHR_TRACE(enqueue, ASYNC_BEGIN, traceKey(res), q.size());
+            vector<unique_ptr<thread>> dead;
+            if (elastic) grow(now, dead);
             notEmpty.notify_one();
+            // 在锁外回收已退出的线程,join不会阻塞其他生产者与消费者
+            locker.unlock();
+            for (auto &t : dead) t->join();
         }
 
         Restype take() {
+            Restype res = nullptr;
+            return fetch(res, false) == Fetch::TASK ? res : nullptr;
+        }
+
+      private:
+        // 需持有锁
+        void report(int from, const char *reason, long long waitus) {
+            fprintf(stderr, "threadpool: %d -> %d threads (%s, queue %zu, wait %lld us, busy %d)\n",
+                    from, threadNum, reason, resQueue.size() + bulkQueue.size(), waitus,
+                    busyNum.load());
+        }
+
+        // 需持有锁,把已退出的线程移到dead中,由调用者在释放锁后join
+        void reap(vector<unique_ptr<thread>> &dead) {
+            for (auto id : retired) {
+                for (auto it = threadGroup.begin(); it != threadGroup.end(); ++it) {
+                    if ((*it)->get_id() == id) {
+                        dead.push_back(std::move(*it));
+                        threadGroup.erase(it);
+                        break;
+                    }
+                }
+            }
+            retired.clear();
+        }
+
+        // 需持有锁,由生产者检查,这样工作线程全部阻塞在磁盘或写操作上时也能扩容
+        void grow(clk::time_point now, vector<unique_ptr<thread>> &dead) {
+            if (threadNum >= opt.maxThread || busyNum.load() < threadNum || !worker) return;
+            auto wait = now - (resQueue.empty() ? bulkQueue : resQueue).front().enqueue;
+            if (wait < opt.targetLatency || now - lastGrow < opt.targetLatency) return;
+            reap(dead);
+            lastGrow = now;
+            threadGroup.push_back(std::make_unique<thread>(worker));
+            ++threadNum;
+            report(threadNum - 1, "grow",
+                   std::chrono::duration_cast<std::chrono::microseconds>(wait).count());
+        }
+
+        Fetch fetch(Restype &res, bool mayRetire) {
             unique_lock<mutex> locker(mtx);
-            notEmpty.wait(locker, [this] { return !isEmpty() || !isrun; });
+            while (isEmpty() && isrun) {
+                if (!elastic || !mayRetire) {
+                    notEmpty.wait(locker);
+                } else if (notEmpty.wait_for(locker, opt.cooldown) == std::cv_status::timeout
+                           && isEmpty() && isrun && threadNum > opt.minThread) {
+                    --threadNum;
+                    retired.push_back(std::this_thread::get_id());
+                    report(threadNum + 1, "idle", 0);
+                    return Fetch::RETIRE;
+                }
+            }
             if (!isrun)
-                return nullptr;
-            Restype res = resQueue.front();
-            resQueue.pop();
+                return Fetch::STOP;
+            bool small = !resQueue.empty() && (bulkQueue.empty() || smallStreak < BULK_RATIO);
+            queue<entry> &q = small ? resQueue : bulkQueue;
+            smallStreak = small ? (smallStreak < BULK_RATIO ? smallStreak + 1 : BULK_RATIO) : 0;
+            res = q.front().res;
+            q.pop();
+            HSHR_TRACE(dequeue, ASYNC_END, traceKey(res), q.size());
             notFull.notify_one();
-            return res;
+            return Fetch::TASK;
         }
 
         template <typename Processtype>
         void task() {
-            while (isrun) {
-                Restype res = take();
+            Restype res;
+            Fetch ret;
+            while ((ret = fetch(res, true)) == Fetch::TASK) {
                 if (res == nullptr){
                     continue;
                 }
+                ++busyNum;
                 Processtype(res).process();
+                --busyNum;
             }
         }
 
+      public:
         template <typename Processtype>
         void work() {
-            for (int i = 0; i < MAX_THREAD_NUM; ++i) {
-                threadGroup[i]
-                    = std::make_unique<thread>((&threadpool<Restype>::task<Processtype>), this);
+            lock_guard<mutex> locker(mtx);
+            worker = [this]() { task<Processtype>(); };
+            for (int i = 0; i < threadNum; ++i) {
+                threadGroup.push_back(std::make_unique<thread>(worker));
             }
         }
     };
@@ -74,7 +74,9 @@ namespace sinksky {
 
         void delTimer(timerNode<Funtype>* timer) { timer->setVaild(); }
 
+        // 截止时间(精度为秒)没有变化时复用原计时器,按配额重新排队的连接不会每次都分配新节点
         timerNode<Funtype>* updateTimer(timerNode<Funtype>* timer, time_t delay) {
+            if (timer->getExpire() == time(NULL) + delay) return timer;
             auto ret = addTimer(delay, timer->getCallBack());
             delTimer(timer);
             return ret;
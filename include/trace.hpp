@@ -0,0 +1,128 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+// USDT 静态探针,未被bpftrace等工具附加时只是一条nop
+// 探针位于提供者hshr下,参数统一为(追踪id, 附加值)
+#if !defined(HSHR_NO_USDT) && defined(__has_include)
+#    if __has_include(<sys/sdt.h>)
+#        include <sys/sdt.h>
+#        define HSHR_USDT_PROBE(name, id, arg) DTRACE_PROBE2(hshr, name, id, arg)
+#    endif
+#endif
+#ifndef HSHR_USDT_PROBE
+#    define HSHR_USDT_PROBE(name, id, arg) \
+        do {                               \
+        } while (0)
+#endif
+
+// 探针同时写入Chrome trace事件(仅在 -t 开启且该id被采样时)
+#define HSHR_TRACE(name, phase, id, arg)                                      \
+    do {                                                                      \
+        HSHR_USDT_PROBE(name, id, arg);                                       \
+        if (sinksky::tracer::sampled(id))                                     \
+            sinksky::tracer::record(#name, sinksky::tracer::phase, id, arg); \
+    } while (0)
+
+namespace sinksky {
+    using std::string;
+
+    // 请求时间线调试模式
+    // 每个线程写一个Chrome trace-event JSON文件,可直接用perfetto或chrome://tracing打开
+    class tracer {
+      public:
+        // 与trace-event格式中的ph字段对应
+        static const char BEGIN = 'B';
+        static const char END = 'E';
+        static const char INSTANT = 'i';
+        static const char ASYNC_BEGIN = 'b';
+        static const char ASYNC_END = 'e';
+
+      private:
+        static const size_t FLUSH_SIZE = 64 * 1024;
+
+        struct config {
+            std::atomic<bool> enabled{false};
+            uint64_t sample = 1;
+            string dir;
+        };
+
+        // 线程本地的事件缓冲,线程退出时补全JSON数组并关闭文件
+        class threadWriter {
+          private:
+            FILE *fp;
+            string buf;
+            long tid;
+
+          public:
+            threadWriter() : fp(nullptr), tid(syscall(SYS_gettid)) {
+                string path = conf().dir + "/trace-" + std::to_string(tid) + ".json";
+                fp = fopen(path.c_str(), "w");
+                buf = "[\n";
+            }
+            ~threadWriter() {
+                if (fp == nullptr) return;
+                buf += "{}]\n";
+                fwrite(buf.data(), 1, buf.size(), fp);
+                fclose(fp);
+            }
+            threadWriter(const threadWriter &) = delete;
+            threadWriter &operator=(const threadWriter &) = delete;
+
+            void append(const char *name, char phase, uint64_t id, int64_t arg) {
+                if (fp == nullptr) return;
+                auto now = std::chrono::steady_clock::now().time_since_epoch();
+                long long us = std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+                char line[256];
+                int len = snprintf(line, sizeof(line),
+                                   "{\"name\":\"%s\",\"cat\":\"hshr\",\"ph\":\"%c\",\"ts\":%lld,"
+                                   "\"pid\":%d,\"tid\":%ld,\"id\":%llu,\"s\":\"t\","
+                                   "\"args\":{\"req\":%llu,\"arg\":%lld}},\n",
+                                   name, phase, us, getpid(), tid, (unsigned long long)id,
+                                   (unsigned long long)id, (long long)arg);
+                buf.append(line, len);
+                if (buf.size() >= FLUSH_SIZE) {
+                    fwrite(buf.data(), 1, buf.size(), fp);
+                    buf.clear();
+                }
+            }
+        };
+
+        static config &conf() {
+            static config c;
+            return c;
+        }
+
+      public:
+        // sample为N表示每N个连接记录一个
+        static void enable(const string &dir, uint64_t sample) {
+            conf().dir = dir;
+            conf().sample = sample == 0 ? 1 : sample;
+            conf().enabled.store(true, std::memory_order_release);
+        }
+
+        static bool sampled(uint64_t id) {
+            return conf().enabled.load(std::memory_order_relaxed) && id % conf().sample == 0;
+        }
+
+        static void record(const char *name, char phase, uint64_t id, int64_t arg) {
+            thread_local std::unique_ptr<threadWriter> writer;
+            if (!writer) writer = std::make_unique<threadWriter>();
+            writer->append(name, phase, id, arg);
+        }
+    };
+
+    // 线程池等通用组件用它取得追踪id,conn会提供更具体的重载
+    template <typename Restype>
+    uint64_t traceKey(const Restype &res) {
+        return (uint64_t)(uintptr_t)res;
+    }
+
+}  // namespace sinksky
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <errno.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "listener.hpp"
+
+namespace sinksky {
+    using std::lock_guard;
+    using std::mutex;
+    using std::pair;
+    using std::string;
+    using std::vector;
+
+    // 反向代理上游配置
+    // 以URL前缀匹配请求,转发到TCP或Unix域套接字地址
+    struct upstreamOption {
+        string prefix;
+        listenOption address;
+        int maxConn = 64;  // 到该上游的最大连接数(包括空闲连接)
+        int timeout = 10;  // 上游连接无事件的超时秒数
+        int idle = 30;     // 空闲连接在池中保留的秒数
+    };
+
+    // 解析形如 /api=tcp:127.0.0.1:9000,max=32,timeout=10,idle=30 的上游描述
+    inline bool parseUpstream(const char *spec, upstreamOption &opt) {
+        string str(spec);
+        auto eq = str.find('=');
+        if (eq == string::npos || str[0] != '/') return false;
+        opt.prefix = str.substr(0, eq);
+        string rest = str.substr(eq + 1);
+        string addr = rest.substr(0, rest.find(','));
+        string opts = addr.size() < rest.size() ? rest.substr(addr.size() + 1) : "";
+        while (!opts.empty()) {
+            string item = opts.substr(0, opts.find(','));
+            opts = item.size() < opts.size() ? opts.substr(item.size() + 1) : "";
+            string key = item.substr(0, item.find('='));
+            int val = key.size() < item.size() ? atoi(item.c_str() + key.size() + 1) : 0;
+            if (key == "max" && val > 0) {
+                opt.maxConn = val;
+            } else if (key == "timeout" && val > 0) {
+                opt.timeout = val;
+            } else if (key == "idle" && val >= 0) {
+                opt.idle = val;
+            } else {
+                return false;
+            }
+        }
+        return parseListen(addr.c_str(), opt.address);
+    }
+
+    // 上游连接池,每个eventloop一个
+    // 空闲的长连接不注册在epoll中,取出时检查对端是否已关闭
+    class upstreamPool {
+      public:
+        static const int NO_UPSTREAM = -1;
+        static const int CONNECT_FAILED = -1;
+        static const int LIMIT_REACHED = -2;
+
+      private:
+        struct upstream {
+            upstreamOption opt;
+            vector<pair<int, time_t>> idleConn;
+            int openNum = 0;
+        };
+        mutex mtx;
+        vector<upstream> upstreams;
+
+        static bool alive(int fd) {
+            char c;
+            auto cnt = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+            return cnt == -1 && errno == EAGAIN;
+        }
+
+        int connectTo(const upstreamOption &opt) {
+            sockaddr_storage address;
+            socklen_t len;
+            int domain = makeAddress(opt.address, address, len);
+            if (domain < 0) return CONNECT_FAILED;
+            int fd = socket(domain, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            if (fd < 0) return CONNECT_FAILED;
+            if (domain != AF_UNIX) {
+                int optval = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+            }
+            if (connect(fd, (sockaddr *)&address, len) < 0 && errno != EINPROGRESS) {
+                close(fd);
+                return CONNECT_FAILED;
+            }
+            return fd;
+        }
+
+      public:
+        upstreamPool() = default;
+        ~upstreamPool() {
+            for (auto &up : upstreams) {
+                for (auto &item : up.idleConn) close(item.first);
+            }
+        }
+        upstreamPool(const upstreamPool &) = delete;
+        upstreamPool &operator=(const upstreamPool &) = delete;
+
+        void init(const vector<upstreamOption> &opts) {
+            lock_guard<mutex> locker(mtx);
+            for (auto &opt : opts) {
+                upstreams.emplace_back();
+                upstreams.back().opt = opt;
+            }
+        }
+
+        bool empty() { return upstreams.empty(); }
+
+        const upstreamOption &option(int index) { return upstreams[index].opt; }
+
+        // 返回前缀最长的匹配上游,没有匹配返回NO_UPSTREAM
+        // 前缀按路径段匹配,/api 匹配 /api /api/x /api?q 而不匹配 /apix
+        int match(const string &url) {
+            int ret = NO_UPSTREAM;
+            size_t best = 0;
+            for (size_t i = 0; i < upstreams.size(); ++i) {
+                const string &prefix = upstreams[i].opt.prefix;
+                if (prefix.size() > best && !url.compare(0, prefix.size(), prefix)
+                    && (url.size() == prefix.size() || prefix.back() == '/'
+                        || url[prefix.size()] == '/' || url[prefix.size()] == '?')) {
+                    ret = i;
+                    best = prefix.size();
+                }
+            }
+            return ret;
+        }
+
+        // 优先复用空闲连接,否则发起非阻塞连接(fresh为true,连接可能仍在进行)
+        int acquire(int index, bool &fresh) {
+            lock_guard<mutex> locker(mtx);
+            upstream &up = upstreams[index];
+            time_t now = time(NULL);
+            while (!up.idleConn.empty()) {
+                auto item = up.idleConn.back();
+                up.idleConn.pop_back();
+                if (now - item.second <= up.opt.idle && alive(item.first)) {
+                    fresh = false;
+                    return item.first;
+                }
+                close(item.first);
+                --up.openNum;
+            }
+            if (up.openNum >= up.opt.maxConn) return LIMIT_REACHED;
+            int fd = connectTo(up.opt);
+            if (fd >= 0) ++up.openNum;
+            fresh = true;
+            return fd;
+        }
+
+        // 响应完整结束的连接放回池中
+        void release(int index, int fd) {
+            lock_guard<mutex> locker(mtx);
+            upstreams[index].idleConn.emplace_back(fd, time(NULL));
+        }
+
+        // 上游连接被关闭
+        void closed(int index) {
+            lock_guard<mutex> locker(mtx);
+            --upstreams[index].openNum;
+        }
+    };
+
+}  // namespace sinksky
@@ -1,29 +1,170 @@
 #include <eventloop.hpp>
+#include <hotrestart.hpp>
+#include <listener.hpp>
+#include <ratelimit.hpp>
 #include <thread>
 #include <threadpool.hpp>
+#include <trace.hpp>
+#include <upstream.hpp>
 
 #include "http/httpdata.cpp"
 #include "http/httpprocess.cpp"
 
+static void usage(const char* name) {
+    printf("usage: %s ip_address port_number\n", name);
+    printf("       %s -l listen_spec [-l listen_spec ...] [ip_address port_number]\n", name);
+    printf("listen_spec: tcp:IP:PORT | tcp6:[IP]:PORT | unix:PATH [,option...]\n");
+    printf("options: backlog=N reuseport noreuseaddr nodelay v6only defer=N rcvbuf=N sndbuf=N "
+           "mode=OCTAL\n");
+    printf("  -w min:max:target_us[:cooldown_ms]  elastic worker pool sized from queue latency\n");
+    printf("  -q bytes[:us]  send quantum per dispatch before a connection is re-queued\n");
+    printf("  -c control_socket  hot restart: take over listening sockets from the process "
+           "serving on control_socket, which then drains and exits\n");
+    printf("  -b bundle[,huge]  serve static files from a bundle built by hshrpack, optionally "
+           "on huge pages\n");
+    printf("  -p /prefix=tcp:IP:PORT|unix:PATH[,max=N][,timeout=S][,idle=S]  reverse proxy URLs "
+           "under prefix to an upstream\n");
+    printf("  -r [conn=N][,rate=R][,burst=B][,idle=S]  per-client-IP connection cap and "
+           "request rate limit\n");
+    printf("  -t dir[,sample=N]  write Chrome trace-event JSON per thread into dir, "
+           "recording 1 in N connections\n");
+}
+
 int main(int argc, char* argv[]) {
     using sinksky::conn;
+    using sinksky::elasticOption;
     using sinksky::eventloop;
     using sinksky::httpdata;
     using sinksky::httpprocess;
+    using sinksky::limitOption;
+    using sinksky::listenOption;
     using sinksky::threadpool;
+    using sinksky::upstreamOption;
 
-    if (argc <= 2) {
-        printf("usage: %s ip_address port_number\n", basename(argv[0]));
+    std::vector<listenOption> listens;
+    std::vector<upstreamOption> upstreams;
+    std::string ctlPath;
+    bool limited = false;
+    limitOption limitOpt;
+    bool elastic = false;
+    elasticOption elasticOpt;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:c:l:p:q:r:t:w:")) != -1) {
+        switch (opt) {
+            case 'b': {
+                std::string spec(optarg);
+                std::string path = spec.substr(0, spec.find(','));
+                bool huge = spec.find(",huge") != std::string::npos;
+                if (!httpdata::assets.load(path.c_str(), huge)) return 1;
+                break;
+            }
+            case 'c': {
+                ctlPath = optarg;
+                break;
+            }
+            case 'l': {
+                listenOption lo;
+                if (!sinksky::parseListen(optarg, lo)) {
+                    printf("bad listen spec: %s\n", optarg);
+                    return 1;
+                }
+                listens.push_back(lo);
+                break;
+            }
+            case 'p': {
+                upstreamOption uo;
+                if (!sinksky::parseUpstream(optarg, uo)) {
+                    printf("bad upstream spec: %s\n", optarg);
+                    return 1;
+                }
+                upstreams.push_back(uo);
+                break;
+            }
+            case 'q': {
+                long long bytes = 0;
+                long long us = httpdata::sendTimeQuantum.count();
+                if (sscanf(optarg, "%lld:%lld", &bytes, &us) < 1 || bytes <= 0 || us <= 0) {
+                    printf("bad quantum spec: %s\n", optarg);
+                    return 1;
+                }
+                httpdata::sendQuantum = bytes;
+                httpdata::sendTimeQuantum = std::chrono::microseconds(us);
+                break;
+            }
+            case 'r': {
+                if (!sinksky::parseLimit(optarg, limitOpt)) {
+                    printf("bad limit spec: %s\n", optarg);
+                    return 1;
+                }
+                limited = true;
+                break;
+            }
+            case 'w': {
+                long long target = 0;
+                long long cooldown = 30000;
+                if (sscanf(optarg, "%d:%d:%lld:%lld", &elasticOpt.minThread,
+                           &elasticOpt.maxThread, &target, &cooldown)
+                        < 3
+                    || elasticOpt.minThread < 1 || elasticOpt.maxThread < elasticOpt.minThread
+                    || target <= 0 || cooldown < 0) {
+                    printf("bad worker spec: %s\n", optarg);
+                    return 1;
+                }
+                elasticOpt.targetLatency = std::chrono::microseconds(target);
+                elasticOpt.cooldown = std::chrono::milliseconds(cooldown);
+                elastic = true;
+                break;
+            }
+            case 't': {
+                std::string spec(optarg);
+                std::string dir = spec.substr(0, spec.find(','));
+                auto pos = spec.find(",sample=");
+                uint64_t sample = pos == std::string::npos ? 1 : atoll(optarg + pos + 8);
+                sinksky::tracer::enable(dir, sample);
+                break;
+            }
+            default: {
+                usage(basename(argv[0]));
+                return 1;
+            }
+        }
+    }
+    if (argc - optind >= 2) {
+        int port;
+        if (!sinksky::parsePort(argv[optind + 1], port)) {
+            printf("bad port: %s\n", argv[optind + 1]);
+            return 1;
+        }
+        listens.push_back(sinksky::inetListen(argv[optind], port));
+    }
+    if (listens.empty()) {
+        usage(basename(argv[0]));
         return 1;
     }
-    const char* ip = argv[1];
-    int port = atoi(argv[2]);
+
+    // 旧进程继续服务,直到新进程预热完成开始accept
+    sinksky::handoff inherited;
+    if (!ctlPath.empty() && sinksky::takeover(ctlPath.c_str(), inherited)) {
+        httpdata::prewarm(inherited.manifest);
+    }
 
     eventloop<httpdata> loop;
-    threadpool<conn<httpdata>*> pool(std::thread::hardware_concurrency(),
-                                     eventloop<httpdata>::MAX_EVENT_NUM);
-    pool.work<httpprocess>();
-    loop.loop(ip, port, &pool);
-    pool.stop();
-    return 0;
-}
\ No newline at end of file
+    loop.setUpstreams(upstreams);
+    if (!ctlPath.empty()) {
+        httpdata::countHot = true;
+        loop.setRestart(ctlPath, std::move(inherited), []() { return httpdata::hot.manifest(); });
+    }
+    if (limited) loop.setLimit(limitOpt);
+    const int queuenum = eventloop<httpdata>::MAX_EVENT_NUM;
+    std::unique_ptr<threadpool<conn<httpdata>*>> pool;
+    if (elastic) {
+        pool = std::make_unique<threadpool<conn<httpdata>*>>(elasticOpt, queuenum);
+    } else {
+        pool = std::make_unique<threadpool<conn<httpdata>*>>(std::thread::hardware_concurrency(),
+                                                             queuenum);
+    }
+    pool->work<httpprocess>();
+    bool ok = loop.loop(listens, pool.get());
+    pool->stop();
+    return ok ? 0 : 1;
+}
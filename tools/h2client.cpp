@@ -0,0 +1,151 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../http/hpack.cpp"
+
+// h2c 测试客户端
+// 使用先验知识建立一个连接,在其上同时发起所有请求,校验多路复用与流量控制
+// 用法: h2client ip port path [path ...]
+// 每个请求输出一行 "path status bytes",所有流正常结束时返回0
+
+using sinksky::headerField;
+using sinksky::hpackDecoder;
+using sinksky::hpackEncoder;
+using std::string;
+using std::vector;
+
+struct streamResult {
+    string path;
+    int status = 0;
+    size_t bytes = 0;
+    bool done = false;
+};
+
+static void putFrame(string &out, uint8_t type, uint8_t flags, uint32_t id, const string &payload) {
+    size_t len = payload.size();
+    char header[9] = {(char)(len >> 16), (char)(len >> 8), (char)len, (char)type, (char)flags,
+                      (char)(id >> 24),  (char)(id >> 16), (char)(id >> 8), (char)id};
+    out.append(header, 9);
+    out += payload;
+}
+
+static void windowUpdate(string &out, uint32_t id, uint32_t inc) {
+    string payload = {(char)(inc >> 24), (char)(inc >> 16), (char)(inc >> 8), (char)inc};
+    putFrame(out, 0x8, 0, id, payload);
+}
+
+static bool sendAll(int fd, const string &buf) {
+    size_t sent = 0;
+    while (sent < buf.size()) {
+        auto cnt = send(fd, buf.data() + sent, buf.size() - sent, 0);
+        if (cnt <= 0) return false;
+        sent += cnt;
+    }
+    return true;
+}
+
+static bool readFull(int fd, char *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        auto cnt = recv(fd, buf + got, len - got, 0);
+        if (cnt <= 0) return false;
+        got += cnt;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        printf("usage: %s ip_address port_number path [path ...]\n", basename(argv[0]));
+        return 1;
+    }
+    sockaddr_in address;
+    bzero(&address, sizeof(address));
+    address.sin_family = AF_INET;
+    inet_pton(AF_INET, argv[1], &address.sin_addr);
+    address.sin_port = htons(atoi(argv[2]));
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (sockaddr *)&address, sizeof(address)) < 0) {
+        perror("connect");
+        return 1;
+    }
+
+    std::map<uint32_t, streamResult> streams;
+    string out = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+    putFrame(out, 0x4, 0, 0, "");
+    for (int i = 3; i < argc; ++i) {
+        uint32_t id = 2 * (i - 3) + 1;
+        string block;
+        hpackEncoder::encode(block, ":method", "GET");
+        hpackEncoder::encode(block, ":scheme", "http");
+        hpackEncoder::encode(block, ":authority", argv[1]);
+        hpackEncoder::encode(block, ":path", argv[i]);
+        putFrame(out, 0x1, 0x4 | 0x1, id, block);
+        streams[id].path = argv[i];
+    }
+    if (!sendAll(fd, out)) return 1;
+
+    hpackDecoder decoder;
+    size_t remain = streams.size();
+    while (remain > 0) {
+        char header[9];
+        if (!readFull(fd, header, 9)) break;
+        const uint8_t *h = (const uint8_t *)header;
+        uint32_t len = (h[0] << 16) | (h[1] << 8) | h[2];
+        uint8_t type = h[3];
+        uint8_t flags = h[4];
+        uint32_t id = ((h[5] & 0x7f) << 24) | (h[6] << 16) | (h[7] << 8) | h[8];
+        vector<char> payload(len);
+        if (len > 0 && !readFull(fd, payload.data(), len)) break;
+
+        out.clear();
+        auto it = streams.find(id);
+        if (type == 0x4 && !(flags & 0x1)) {
+            putFrame(out, 0x4, 0x1, 0, "");
+        } else if (type == 0x6 && !(flags & 0x1)) {
+            putFrame(out, 0x6, 0x1, 0, string(payload.begin(), payload.end()));
+        } else if (type == 0x7) {
+            fprintf(stderr, "GOAWAY received\n");
+            break;
+        } else if (type == 0x3 && it != streams.end()) {
+            fprintf(stderr, "stream %u reset\n", id);
+            break;
+        } else if (type == 0x1 && it != streams.end()) {
+            vector<headerField> headers;
+            if (!decoder.decode((const uint8_t *)payload.data(), len, headers)) {
+                fprintf(stderr, "header decode failed on stream %u\n", id);
+                break;
+            }
+            for (auto &field : headers) {
+                if (field.first == ":status") it->second.status = atoi(field.second.c_str());
+            }
+        } else if (type == 0x0 && it != streams.end()) {
+            it->second.bytes += len;
+            if (len > 0) {
+                windowUpdate(out, 0, len);
+                if (!(flags & 0x1)) windowUpdate(out, id, len);
+            }
+        }
+        if ((type == 0x0 || type == 0x1) && (flags & 0x1) && it != streams.end()
+            && !it->second.done) {
+            it->second.done = true;
+            --remain;
+        }
+        if (!out.empty() && !sendAll(fd, out)) break;
+    }
+    close(fd);
+
+    for (auto &item : streams) {
+        printf("%s %d %zu\n", item.second.path.c_str(), item.second.status, item.second.bytes);
+    }
+    return remain == 0 ? 0 : 1;
+}
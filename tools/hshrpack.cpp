@@ -0,0 +1,302 @@
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef HSHR_ZLIB
+#    include <zlib.h>
+#endif
+
+#include "../http/bundle.cpp"
+
+// 静态资源打包工具
+// 把文档根目录打包成一个文件,服务器用 -b 映射后不再访问文件系统
+// 用法: hshrpack [-z] root output
+// 与文件同目录的 name.gz 作为该文件的预压缩版本; -z 为没有 .gz 的文本文件生成gzip版本(需要zlib)
+
+using sinksky::bundleEntry;
+using sinksky::bundleHash;
+using sinksky::bundleHeader;
+using sinksky::bundleSlice;
+using std::string;
+using std::vector;
+
+struct asset {
+    string url;
+    string path;
+};
+
+static vector<asset> assets;
+static size_t rootLen;
+
+// 输出文件与已写出的字节数,响应体逐个写出,内存中只保留当前文件
+static FILE *out;
+static uint64_t outSize;
+
+static bool readFile(const string &path, string &out) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr) return false;
+    char buf[65536];
+    size_t cnt;
+    out.clear();
+    while ((cnt = fread(buf, 1, sizeof(buf), fp)) > 0) out.append(buf, cnt);
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+// 与服务器读取文件时的权限检查一致,只打包其他用户可读的普通文件
+static int collect(const char *path, const struct stat *st, int type, struct FTW *) {
+    if (type != FTW_F || !S_ISREG(st->st_mode) || !(st->st_mode & S_IROTH)) return 0;
+    asset a;
+    a.path = path;
+    a.url = a.path.substr(rootLen);
+    if (a.url.empty() || a.url[0] != '/') a.url = "/" + a.url;
+    assets.push_back(a);
+    return 0;
+}
+
+static const char *contentType(const string &url) {
+    static const char *types[][2] = {
+        {".html", "text/html"},       {".htm", "text/html"},
+        {".css", "text/css"},         {".js", "application/javascript"},
+        {".json", "application/json"}, {".txt", "text/plain"},
+        {".xml", "application/xml"},  {".svg", "image/svg+xml"},
+        {".png", "image/png"},        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},      {".gif", "image/gif"},
+        {".webp", "image/webp"},      {".ico", "image/x-icon"},
+        {".wasm", "application/wasm"}, {".woff2", "font/woff2"},
+        {".gz", "application/gzip"},
+    };
+    for (auto &t : types) {
+        size_t len = strlen(t[0]);
+        if (url.size() > len && !url.compare(url.size() - len, len, t[0])) return t[1];
+    }
+    return "application/octet-stream";
+}
+
+static bool compressible(const char *type) {
+    return !strncmp(type, "text/", 5) || !strcmp(type, "application/javascript")
+           || !strcmp(type, "application/json") || !strcmp(type, "application/xml")
+           || !strcmp(type, "image/svg+xml") || !strcmp(type, "application/wasm");
+}
+
+static bool gzipCompress(const string &in, string &out) {
+#ifdef HSHR_ZLIB
+    // 复用同一个压缩流,避免每个文件重新分配几百KB的内部状态
+    static z_stream zs;
+    static bool ready = false;
+    if (!ready) {
+        if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY)
+            != Z_OK)
+            return false;
+        ready = true;
+    } else {
+        deflateReset(&zs);
+    }
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = (Bytef *)in.data();
+    zs.avail_in = in.size();
+    zs.next_out = (Bytef *)&out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    return ret == Z_STREAM_END;
+#else
+    (void)in;
+    (void)out;
+    return false;
+#endif
+}
+
+// 为每个种子0的桶找一个种子,使桶内所有URL落到尚未占用的表项
+static bool buildTable(vector<uint32_t> &table, vector<uint32_t> &slotOf) {
+    uint32_t count = assets.size();
+    vector<vector<uint32_t>> buckets(table.size());
+    for (uint32_t i = 0; i < count; ++i) {
+        buckets[bundleHash(assets[i].url.data(), assets[i].url.size(), 0) % table.size()].push_back(i);
+    }
+    vector<uint32_t> order(table.size());
+    for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+    vector<bool> used(count, false);
+    vector<uint32_t> slots;
+    for (uint32_t b : order) {
+        if (buckets[b].empty()) break;
+        uint32_t seed = 1;
+        for (; seed < (1u << 24); ++seed) {
+            slots.clear();
+            bool ok = true;
+            for (uint32_t i : buckets[b]) {
+                uint32_t slot = bundleHash(assets[i].url.data(), assets[i].url.size(), seed) % count;
+                if (used[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+                    ok = false;
+                    break;
+                }
+                slots.push_back(slot);
+            }
+            if (ok) break;
+        }
+        if (seed == (1u << 24)) return false;
+        table[b] = seed;
+        for (size_t k = 0; k < slots.size(); ++k) {
+            used[slots[k]] = true;
+            slotOf[buckets[b][k]] = slots[k];
+        }
+    }
+    return true;
+}
+
+static bundleSlice append(string &blob, const string &data) {
+    bundleSlice s{blob.size(), data.size()};
+    blob += data;
+    return s;
+}
+
+static bool emit(const void *data, size_t len, size_t align, bundleSlice &s) {
+    static const char zeros[64] = {0};
+    size_t pad = (align - outSize % align) % align;
+    if (fwrite(zeros, 1, pad, out) != pad) return false;
+    outSize += pad;
+    s = bundleSlice{outSize, len};
+    if (fwrite(data, 1, len, out) != len) return false;
+    outSize += len;
+    return true;
+}
+
+static int writeError(const char *path) {
+    perror(path);
+    if (out != nullptr) fclose(out);
+    unlink(path);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    bool compress = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "z")) != -1) {
+        if (opt == 'z') {
+            compress = true;
+        } else {
+            printf("usage: %s [-z] root output\n", basename(argv[0]));
+            return 1;
+        }
+    }
+    if (argc - optind < 2) {
+        printf("usage: %s [-z] root output\n", basename(argv[0]));
+        return 1;
+    }
+#ifndef HSHR_ZLIB
+    if (compress) fprintf(stderr, "built without zlib, -z only uses existing .gz files\n");
+#endif
+    string root = argv[optind];
+    while (root.size() > 1 && root.back() == '/') root.pop_back();
+    rootLen = root.size();
+    if (nftw(root.c_str(), collect, 64, FTW_PHYS) != 0) {
+        perror(root.c_str());
+        return 1;
+    }
+    std::sort(assets.begin(), assets.end(),
+              [](const asset &a, const asset &b) { return a.url < b.url; });
+
+    uint32_t count = assets.size();
+    vector<uint32_t> table(std::max<uint32_t>(1, count / 4), 0);
+    vector<uint32_t> slotOf(count);
+    if (!buildTable(table, slotOf)) {
+        fprintf(stderr, "failed to build perfect hash\n");
+        return 1;
+    }
+
+    // 布局: 文件头 | 种子表 | 表项 | 响应体 | URL,ETag与响应头
+    // 文件头与表项先占位,响应体逐个读入后立即写出,最后回填
+    const char *output = argv[optind + 1];
+    out = fopen(output, "wb");
+    if (out == nullptr) return writeError(output);
+    bundleHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, sinksky::bundleMagic, sizeof(header.magic));
+    header.version = sinksky::bundleVersion;
+    header.count = count;
+    header.tableSize = table.size();
+    vector<bundleEntry> entries(count);
+    bundleSlice slice;
+    if (!emit(&header, sizeof(header), 1, slice)) return writeError(output);
+    if (!emit(table.data(), table.size() * sizeof(uint32_t), 8, slice)) return writeError(output);
+    header.tableOffset = slice.offset;
+    if (!emit(entries.data(), count * sizeof(bundleEntry), 8, slice)) return writeError(output);
+    header.entryOffset = slice.offset;
+
+    // 字符串的偏移先相对于meta,写出meta后再加上它在文件中的位置
+    string meta;
+    size_t gzipNum = 0;
+    string body, gzip;
+    for (uint32_t i = 0; i < count; ++i) {
+        asset &a = assets[i];
+        bundleEntry &e = entries[slotOf[i]];
+        if (!readFile(a.path, body)) {
+            perror(a.path.c_str());
+            fclose(out);
+            unlink(output);
+            return 1;
+        }
+        gzip.clear();
+        struct stat st;
+        string gzPath = a.path + ".gz";
+        if (stat(gzPath.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            readFile(gzPath, gzip);
+        } else if (compress && body.size() >= 256 && compressible(contentType(a.url))) {
+            if (!gzipCompress(body, gzip) || gzip.size() >= body.size() * 9 / 10) gzip.clear();
+        }
+        if (!emit(body.data(), body.size(), 64, e.body)) return writeError(output);
+
+        char etag[64];
+        snprintf(etag, sizeof(etag), "\"%llx-%llx\"", (unsigned long long)body.size(),
+                 (unsigned long long)bundleHash(body.data(), body.size(), 0));
+        const char *type = contentType(a.url);
+        const char *vary = gzip.empty() ? "" : "Vary: Accept-Encoding\r\n";
+        char head[512];
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\nContent-Type: %s\r\nETag: %s\r\n%s",
+                 body.size(), type, etag, vary);
+        e.url = append(meta, a.url);
+        e.etag = append(meta, etag);
+        e.head = append(meta, head);
+        if (!gzip.empty()) {
+            ++gzipNum;
+            if (!emit(gzip.data(), gzip.size(), 64, e.gzipBody)) return writeError(output);
+            snprintf(etag, sizeof(etag), "\"%llx-%llx-gz\"", (unsigned long long)gzip.size(),
+                     (unsigned long long)bundleHash(gzip.data(), gzip.size(), 0));
+            snprintf(head, sizeof(head),
+                     "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\nContent-Type: %s\r\nETag: %s\r\n"
+                     "%sContent-Encoding: gzip\r\n",
+                     gzip.size(), type, etag, vary);
+            e.gzipEtag = append(meta, etag);
+            e.gzipHead = append(meta, head);
+        }
+    }
+    if (!emit(meta.data(), meta.size(), 1, slice)) return writeError(output);
+    for (auto &e : entries) {
+        for (bundleSlice *s : {&e.url, &e.etag, &e.head, &e.gzipHead, &e.gzipEtag}) {
+            if (s->len != 0) s->offset += slice.offset;
+        }
+    }
+    header.fileSize = outSize;
+    bool ok = fseeko(out, 0, SEEK_SET) == 0
+              && fwrite(&header, 1, sizeof(header), out) == sizeof(header)
+              && fseeko(out, header.entryOffset, SEEK_SET) == 0
+              && fwrite(entries.data(), sizeof(bundleEntry), count, out) == count;
+    if (fclose(out) != 0 || !ok) {
+        out = nullptr;
+        return writeError(output);
+    }
+    printf("%u files (%zu gzip) -> %s, %llu bytes\n", count, gzipNum, output,
+           (unsigned long long)outSize);
+    return 0;
+}